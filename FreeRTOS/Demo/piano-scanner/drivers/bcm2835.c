@@ -116,6 +116,7 @@ unsigned int bcm2835_version(void)
 	return BCM2835_VERSION;
 }
 
+#if BCM2835_DEBUG_ACCESS
 /* Read with memory barriers from peripheral
  *
  */
@@ -195,6 +196,7 @@ void bcm2835_peri_set_bits(volatile uint32_t* paddr, uint32_t value, uint32_t ma
 	v = (v & ~mask) | (value & mask);
 	bcm2835_peri_write(paddr, v);
 }
+#endif
 
 /*
 // Low level convenience functions
@@ -228,6 +230,7 @@ void bcm2835_gpio_fsel(uint8_t pin, uint8_t mode)
 	bcm2835_peri_set_bits(paddr, value, mask);
 }
 
+#if BCM2835_DEBUG_ACCESS
 /* Set output pin */
 void bcm2835_gpio_set(uint8_t pin)
 {
@@ -266,6 +269,7 @@ uint8_t bcm2835_gpio_lev(uint8_t pin)
 	uint32_t value = bcm2835_peri_read(paddr);
 	return (value & (1 << shift)) ? HIGH : LOW;
 }
+#endif
 
 /* See if an event detection bit is set
 // Sigh cant support interrupts yet
@@ -483,6 +483,16 @@
 
 #define BCM2835_VERSION 10052 /* Version 1.52 */
 
+/*! Build the register and gpio accessors (bcm2835_peri_*, bcm2835_gpio_set,
+  _clr, _set_multi, _clr_multi and _lev) out of line, so that after
+  bcm2835_set_debug(1) they print what they would do instead of touching the
+  hardware. Off by default: the accessors are then static inline and the
+  debug flag only affects the rest of the library.
+*/
+#ifndef BCM2835_DEBUG_ACCESS
+#define BCM2835_DEBUG_ACCESS 0
+#endif
+
 /* RPi 2 is ARM v7, and has DMB instruction for memory barriers.
    Older RPis are ARM v6 and don't, so a coprocessor instruction must be used instead.
    However, not all versions of gcc in all distros support the dmb assembler instruction even on conmpatible processors.
@@ -1089,6 +1099,63 @@ extern "C" {
 
     /*! @} */
 
+#if !BCM2835_DEBUG_ACCESS
+    /* Fast path accessors. Without BCM2835_DEBUG_ACCESS the register and gpio
+       accessors below are these static inline versions, a single load or store
+       with no call and no test of the debug flag, and the out of line versions
+       in bcm2835.c are not built. The extern declarations that follow take on
+       their internal linkage. */
+    static inline uint32_t bcm2835_peri_read(volatile uint32_t* paddr)
+    {
+        return *paddr;
+    }
+
+    static inline uint32_t bcm2835_peri_read_nb(volatile uint32_t* paddr)
+    {
+        return *paddr;
+    }
+
+    static inline void bcm2835_peri_write(volatile uint32_t* paddr, uint32_t value)
+    {
+        *paddr = value;
+    }
+
+    static inline void bcm2835_peri_write_nb(volatile uint32_t* paddr, uint32_t value)
+    {
+        *paddr = value;
+    }
+
+    static inline void bcm2835_peri_set_bits(volatile uint32_t* paddr, uint32_t value, uint32_t mask)
+    {
+        *paddr = (*paddr & ~mask) | (value & mask);
+    }
+
+    static inline void bcm2835_gpio_set(uint8_t pin)
+    {
+        bcm2835_gpio[BCM2835_GPSET0/4 + pin/32] = 1 << (pin % 32);
+    }
+
+    static inline void bcm2835_gpio_clr(uint8_t pin)
+    {
+        bcm2835_gpio[BCM2835_GPCLR0/4 + pin/32] = 1 << (pin % 32);
+    }
+
+    static inline void bcm2835_gpio_set_multi(uint32_t mask)
+    {
+        bcm2835_gpio[BCM2835_GPSET0/4] = mask;
+    }
+
+    static inline void bcm2835_gpio_clr_multi(uint32_t mask)
+    {
+        bcm2835_gpio[BCM2835_GPCLR0/4] = mask;
+    }
+
+    static inline uint8_t bcm2835_gpio_lev(uint8_t pin)
+    {
+        return (bcm2835_gpio[BCM2835_GPLEV0/4 + pin/32] & (1 << (pin % 32))) ? HIGH : LOW;
+    }
+#endif
+
     /*! \defgroup lowlevel Low level register access
       These functions provide low level register access, and should not generally
       need to be used 
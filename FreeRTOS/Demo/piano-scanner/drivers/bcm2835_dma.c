@@ -0,0 +1,172 @@
+/*
+ * bcm2835_dma.c
+ *
+ *  Description:
+ *  The BCM2835 DMA engine, see bcm2835_dma.h
+ */
+
+#include "bcm2835_dma.h"
+#include "bcm2835_irq.h"
+#include "bcm2835_intc.h"
+
+#define _BCM2835_DMA_BASE 0x20007000
+#define _BCM2835_DMA_CHANNEL_STRIDE 0x100
+
+#define _BCM2835_PERI_BUS_BASE 0x7E000000
+#define _BCM2835_RAM_BUS_BASE 0x40000000
+
+typedef struct {
+	uint32_t CS; /* Control and Status */
+	uint32_t CONBLK_AD; /* Control Block Address */
+	uint32_t TI; /* Transfer Information, of the current block */
+	uint32_t SOURCE_AD;
+	uint32_t DEST_AD;
+	uint32_t TXFR_LEN;
+	uint32_t STRIDE;
+	uint32_t NEXTCONBK;
+	uint32_t DEBUG;
+} _bcm2835_dma_regs;
+
+/* CS */
+#define _BCM2835_DMA_CS_RESET (1u << 31)
+#define _BCM2835_DMA_CS_WAIT_FOR_OUTSTANDING_WRITES (1 << 28)
+#define _BCM2835_DMA_CS_PANIC_PRIORITY(p) ((p) << 20)
+#define _BCM2835_DMA_CS_PRIORITY(p) ((p) << 16)
+#define _BCM2835_DMA_CS_WAITING_FOR_OUTSTANDING_WRITES (1 << 6)
+#define _BCM2835_DMA_CS_INT (1 << 2)
+#define _BCM2835_DMA_CS_END (1 << 1)
+#define _BCM2835_DMA_CS_ACTIVE (1 << 0)
+
+/* DEBUG, write 1 to clear */
+#define _BCM2835_DMA_DEBUG_ERRORS 0x7
+
+#define _BCM2835_DMA_SHARED_FIRST 11
+
+static volatile _bcm2835_dma_regs* channel_regs(int channel) {
+	return (volatile _bcm2835_dma_regs*)(_BCM2835_DMA_BASE + channel * _BCM2835_DMA_CHANNEL_STRIDE);
+}
+
+static uint32_t s_allocated = 0;
+static bcm2835_dma_handler s_handlers[BCM2835_DMA_CHANNELS];
+static void *s_params[BCM2835_DMA_CHANNELS];
+
+static void reset_channel(int channel) {
+	channel_regs(channel)->CS = _BCM2835_DMA_CS_RESET;
+	channel_regs(channel)->DEBUG = _BCM2835_DMA_DEBUG_ERRORS;
+}
+
+/* Only used while setting up, before anything runs that could allocate
+ * at the same time */
+int bcm2835_dma_channel_alloc() {
+	for (int channel = 0; channel < BCM2835_DMA_CHANNELS; channel++) {
+		uint32_t bit = 1 << channel;
+		if ((BCM2835_DMA_CHANNEL_MASK & bit) && !(s_allocated & bit)) {
+			s_allocated |= bit;
+			reset_channel(channel);
+			return channel;
+		}
+	}
+	return -1;
+}
+
+void bcm2835_dma_channel_free(int channel) {
+	bcm2835_dma_abort(channel);
+	if (channel < _BCM2835_DMA_SHARED_FIRST) {
+		bcm2835_irq_disable(BCM2835_IRQ_ID_DMA_0 + channel);
+	}
+	s_handlers[channel] = NULL;
+	s_allocated &= ~(1 << channel);
+}
+
+/* Writing INT and END back clears them. ACTIVE is written back as read
+ * so a channel interrupting part way along its chain carries on. */
+static void complete(int channel) {
+	volatile _bcm2835_dma_regs* regs = channel_regs(channel);
+	uint32_t cs = regs->CS;
+	if (!(cs & _BCM2835_DMA_CS_INT)) {
+		return;
+	}
+	regs->CS = (cs & _BCM2835_DMA_CS_ACTIVE) | _BCM2835_DMA_CS_INT | _BCM2835_DMA_CS_END;
+	if (s_handlers[channel] != NULL) {
+		s_handlers[channel](channel, s_params[channel]);
+	}
+}
+
+static void interrupt_handler(uint32_t nIRQ, void *pParam) {
+	complete((int)(uintptr_t)pParam);
+}
+
+static void shared_interrupt_handler(uint32_t nIRQ, void *pParam) {
+	for (int channel = _BCM2835_DMA_SHARED_FIRST; channel < BCM2835_DMA_CHANNELS; channel++) {
+		if (s_allocated & (1 << channel)) {
+			complete(channel);
+		}
+	}
+}
+
+void bcm2835_dma_set_handler(int channel, bcm2835_dma_handler handler, void *param) {
+	s_params[channel] = param;
+	s_handlers[channel] = handler;
+	if (channel < _BCM2835_DMA_SHARED_FIRST) {
+		bcm2835_irq_register(BCM2835_IRQ_ID_DMA_0 + channel, interrupt_handler, (void *)(uintptr_t)channel);
+		bcm2835_irq_enable(BCM2835_IRQ_ID_DMA_0 + channel);
+	} else {
+		bcm2835_irq_register(BCM2835_IRQ_ID_DMA_SHARED, shared_interrupt_handler, NULL);
+		bcm2835_irq_enable(BCM2835_IRQ_ID_DMA_SHARED);
+	}
+}
+
+void bcm2835_dma_start(int channel, const bcm2835_dma_cb *cb) {
+	volatile _bcm2835_dma_regs* regs = channel_regs(channel);
+	regs->CS = _BCM2835_DMA_CS_END;
+	regs->CONBLK_AD = bcm2835_dma_bus_address(cb);
+	regs->CS = _BCM2835_DMA_CS_WAIT_FOR_OUTSTANDING_WRITES | _BCM2835_DMA_CS_PANIC_PRIORITY(15)
+			| _BCM2835_DMA_CS_PRIORITY(8) | _BCM2835_DMA_CS_ACTIVE;
+}
+
+bool bcm2835_dma_busy(int channel) {
+	return (channel_regs(channel)->CS & _BCM2835_DMA_CS_ACTIVE) ? true : false;
+}
+
+/* Pauses the channel and lets its writes land before the reset */
+void bcm2835_dma_abort(int channel) {
+	volatile _bcm2835_dma_regs* regs = channel_regs(channel);
+	regs->CS = 0;
+	while (regs->CS & _BCM2835_DMA_CS_WAITING_FOR_OUTSTANDING_WRITES);
+	reset_channel(channel);
+}
+
+uint32_t bcm2835_dma_bus_address(const void *ram) {
+	return (uint32_t)(uintptr_t)ram | _BCM2835_RAM_BUS_BASE;
+}
+
+uint32_t bcm2835_dma_peripheral_address(volatile const void *reg) {
+	return ((uint32_t)(uintptr_t)reg & 0x00FFFFFF) | _BCM2835_PERI_BUS_BASE;
+}
+
+void bcm2835_dma_cb_memcpy(bcm2835_dma_cb *cb, void *dest, const void *src, uint32_t length) {
+	cb->ti = BCM2835_DMA_TI_SRC_INC | BCM2835_DMA_TI_DEST_INC | BCM2835_DMA_TI_WAIT_RESP;
+	cb->source_ad = bcm2835_dma_bus_address(src);
+	cb->dest_ad = bcm2835_dma_bus_address(dest);
+	cb->txfr_len = length;
+	cb->stride = 0;
+	cb->nextconbk = 0;
+}
+
+void bcm2835_dma_cb_to_peripheral(bcm2835_dma_cb *cb, volatile void *reg, const void *src, uint32_t length, uint32_t dreq) {
+	cb->ti = BCM2835_DMA_TI_SRC_INC | BCM2835_DMA_TI_DEST_DREQ | BCM2835_DMA_TI_PERMAP(dreq) | BCM2835_DMA_TI_WAIT_RESP;
+	cb->source_ad = bcm2835_dma_bus_address(src);
+	cb->dest_ad = bcm2835_dma_peripheral_address(reg);
+	cb->txfr_len = length;
+	cb->stride = 0;
+	cb->nextconbk = 0;
+}
+
+void bcm2835_dma_cb_from_peripheral(bcm2835_dma_cb *cb, void *dest, volatile const void *reg, uint32_t length, uint32_t dreq) {
+	cb->ti = BCM2835_DMA_TI_DEST_INC | BCM2835_DMA_TI_SRC_DREQ | BCM2835_DMA_TI_PERMAP(dreq) | BCM2835_DMA_TI_WAIT_RESP;
+	cb->source_ad = bcm2835_dma_peripheral_address(reg);
+	cb->dest_ad = bcm2835_dma_bus_address(dest);
+	cb->txfr_len = length;
+	cb->stride = 0;
+	cb->nextconbk = 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * bcm2835_dma.h
+ *
+ *  Description:
+ *  The BCM2835 DMA engine. A channel runs a chain of control blocks,
+ *  each a transfer between memory and memory or a peripheral, paced by
+ *  the peripheral's DREQ when it has one, and interrupts when a block
+ *  with BCM2835_DMA_TI_INTEN completes. Channels are handed out from
+ *  the ones the firmware leaves to the ARM.
+ *
+ *  The engine works on bus addresses; the helpers that fill control
+ *  blocks convert ARM addresses. Nothing here enables the MMU, so the
+ *  data cache is off and no cache maintenance is needed.
+ */
+
+#ifndef _BCM2835_DMA_H_
+#define _BCM2835_DMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Channels free for the ARM, the firmware's default dma.dmachans. The
+ * others belong to the GPU. */
+#ifndef BCM2835_DMA_CHANNEL_MASK
+#define BCM2835_DMA_CHANNEL_MASK 0x7F35
+#endif
+
+#define BCM2835_DMA_CHANNELS 15
+
+/* Control block transfer information (TI) */
+#define BCM2835_DMA_TI_INTEN (1 << 0)
+#define BCM2835_DMA_TI_WAIT_RESP (1 << 3)
+#define BCM2835_DMA_TI_DEST_INC (1 << 4)
+#define BCM2835_DMA_TI_DEST_WIDTH_128 (1 << 5)
+#define BCM2835_DMA_TI_DEST_DREQ (1 << 6)
+#define BCM2835_DMA_TI_SRC_INC (1 << 8)
+#define BCM2835_DMA_TI_SRC_WIDTH_128 (1 << 9)
+#define BCM2835_DMA_TI_SRC_DREQ (1 << 10)
+#define BCM2835_DMA_TI_PERMAP(dreq) ((dreq) << 16)
+#define BCM2835_DMA_TI_NO_WIDE_BURSTS (1 << 26)
+
+/* Peripheral DREQs, for BCM2835_DMA_TI_PERMAP */
+#define BCM2835_DMA_DREQ_SPI_TX 6
+#define BCM2835_DMA_DREQ_SPI_RX 7
+#define BCM2835_DMA_DREQ_UART_TX 12
+#define BCM2835_DMA_DREQ_UART_RX 14
+
+/* A control block. The engine only takes them on 32 byte boundaries. */
+typedef struct {
+	uint32_t ti;
+	uint32_t source_ad;
+	uint32_t dest_ad;
+	uint32_t txfr_len;
+	uint32_t stride;
+	uint32_t nextconbk;
+	uint32_t reserved[2];
+} __attribute__((aligned(32))) bcm2835_dma_cb;
+
+/* Called from the channel's interrupt when a control block with
+ * BCM2835_DMA_TI_INTEN completes */
+typedef void (*bcm2835_dma_handler)(int channel, void *param);
+
+/**
+ * Takes the lowest free channel in BCM2835_DMA_CHANNEL_MASK and resets
+ * it. Returns -1 if there is none.
+ */
+int bcm2835_dma_channel_alloc();
+
+void bcm2835_dma_channel_free(int channel);
+
+/**
+ * Sets the completion handler of a channel and enables its interrupt.
+ * Channels 11 to 14 share one interrupt, which calls the handler of
+ * each channel that has completed.
+ */
+void bcm2835_dma_set_handler(int channel, bcm2835_dma_handler handler, void *param);
+
+/* Starts a channel on a chain of control blocks */
+void bcm2835_dma_start(int channel, const bcm2835_dma_cb *cb);
+
+/* True until the last control block of the chain has completed */
+bool bcm2835_dma_busy(int channel);
+
+/* Stops a channel where it is and resets it */
+void bcm2835_dma_abort(int channel);
+
+/* Bus addresses of RAM, through the L2 coherent alias, and of a peripheral register */
+uint32_t bcm2835_dma_bus_address(const void *ram);
+uint32_t bcm2835_dma_peripheral_address(volatile const void *reg);
+
+/* Fills a control block for a copy of length bytes between memory */
+void bcm2835_dma_cb_memcpy(bcm2835_dma_cb *cb, void *dest, const void *src, uint32_t length);
+
+/**
+ * Fills a control block writing length bytes from memory to a peripheral
+ * register, one 32 bit word at a time, paced by the peripheral's DREQ
+ */
+void bcm2835_dma_cb_to_peripheral(bcm2835_dma_cb *cb, volatile void *reg, const void *src, uint32_t length, uint32_t dreq);
+
+/**
+ * Fills a control block reading length bytes from a peripheral register
+ * to memory, one 32 bit word at a time, paced by the peripheral's DREQ
+ */
+void bcm2835_dma_cb_from_peripheral(bcm2835_dma_cb *cb, void *dest, volatile const void *reg, uint32_t length, uint32_t dreq);
+
+#endif /* _BCM2835_DMA_H_ */
@@ -15,6 +15,9 @@
 #define BCM2835_IRQ_DISABLE2		(BCM2835_BASE_INTC + 0x20)
 #define BCM2835_IRQ_DISABLE_BASIC	(BCM2835_BASE_INTC + 0x24)
 
+/* DMA channels 0 to 10 interrupt on 16 to 26, channels 11 to 14 share 27 */
+#define BCM2835_IRQ_ID_DMA_0		16
+#define BCM2835_IRQ_ID_DMA_SHARED	27
 #define BCM2835_IRQ_ID_AUX			29
 #define BCM2835_IRQ_ID_SPI_SLAVE 	43
 #define BCM2835_IRQ_ID_PWA0			45
@@ -77,13 +77,28 @@ void bcm2835_irq_block (void)
 	asm volatile ("cpsid i" ::: "memory");
 }
 
+uint32_t bcm2835_irq_save (void)
+{
+	uint32_t cpsr;
+	asm volatile ("mrs %0, cpsr\n\tcpsid i" : "=r" (cpsr) : : "memory");
+	return cpsr;
+}
+
+void bcm2835_irq_restore (uint32_t cpsr)
+{
+	asm volatile ("msr cpsr_c, %0" : : "r" (cpsr) : "memory");
+}
+
+/* Leaves IRQs masked if they were on entry rather than unblocking them, so
+ * registering a handler never lets interrupts in before the scheduler starts
+ * or inside a critical section. */
 void bcm2835_irq_register (const uint32_t irq, FN_INTERRUPT_HANDLER pfnHandler, void *pParam)
 {
 	if (irq < BCM2835_INTC_TOTAL_IRQ) {
-		bcm2835_irq_block();
+		uint32_t cpsr = bcm2835_irq_save();
 		g_VectorTable[irq].pfnHandler = pfnHandler;
 		g_VectorTable[irq].pParam     = pParam;
-		bcm2835_irq_unblock();
+		bcm2835_irq_restore(cpsr);
 	}
 }
 
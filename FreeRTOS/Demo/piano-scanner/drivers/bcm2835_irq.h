@@ -34,5 +34,9 @@ void bcm2835_irq_enable(const uint32_t irq);
 void bcm2835_irq_disable(const uint32_t irq);
 void bcm2835_irq_block(void);
 void bcm2835_irq_unblock(void);
+/* Masks IRQs and returns the previous CPSR for bcm2835_irq_restore(), so it
+ * nests inside anything that already has them masked */
+uint32_t bcm2835_irq_save(void);
+void bcm2835_irq_restore(uint32_t cpsr);
 
 #endif
@@ -7,6 +7,8 @@
 #include "bcm2835_miniuart.h"
 #include "bcm2835.h"
 #include "bcm2835_auxiliary.h"
+#include "bcm2835_irq.h"
+#include "bcm2835_intc.h"
 
 /* Both UART use the system clock which is 250Mhz */
 
@@ -49,6 +51,13 @@ typedef struct {
 #define _BCM2835_CNTL_RX_ENABLE 1
 #define _BCM2835_CNTL_TX_ENABLE 0
 
+/* AUX_MU_IER_REG */
+#define _BCM2835_IER_RX_ENABLE 0
+#define _BCM2835_IER_TX_ENABLE 1
+/* Documented as don't care, but the receive interrupt is never raised unless
+ * both are set (BCM2835 datasheet errata) */
+#define _BCM2835_IER_RX_REQUIRED (3 << 2)
+
 /* AUX_MU_LSR_REG */
 #define _BCM2835_LSR_
 #define _BCM2835_LSR_TX_IDLE 6
@@ -56,32 +65,6 @@ typedef struct {
 #define _BCM2835_LSR_RECV_OVERRUN 1
 #define _BCM2835_LSR_DATA_RDY 0
 
-typedef struct {
-	uint32_t DR; /* Data Register */
-	uint32_t RSRECR;
-	uint32_t reserved0; /* 0x08 */
-	uint32_t reserved1; /* 0x0C */
-	uint32_t reserved2; /* 0x10 */
-	uint32_t reserved3; /* 0x14 */
-	uint32_t FR; /* Flag Register */
-	uint32_t reserved4; /* 0x1C */
-	uint32_t ILPAR; /* Not used */
-	uint32_t IBRD; /* Integer Baud Rate Divisor */
-	uint32_t FBRD; /* Fractional Baud Rate Divisor */
-	uint32_t LCRH; /* Line Control Register */
-	uint32_t CR; /* Control Register */
-	uint32_t IFLS; /* Interrupt FIFO Level Select Register */
-	uint32_t IMSC; /* Interrupt Mask Set Register */
-	uint32_t RIS; /* Raw Interrupt Status Register */
-	uint32_t MIS; /* Masked Interrupt Status Register */
-	uint32_t ICR; /* Interrupt Clear Register */
-	uint32_t DMACR; /* DMA Control Register */
-	uint32_t ITCR; /* Test Control Register */
-	uint32_t ITIP; /* Integration Test Input Register */
-	uint32_t ITOP; /* Integration Test Output Register */
-	uint32_t TDR; /* Test Data Reg */
-} _bcm2835_uart0_regs;
-
 static volatile _bcm2835_uart1_regs* pMiniUARTRegs = (_bcm2835_uart1_regs*)_BCM2835_MINIUART_BASE;
 
 /* From documentation:
@@ -91,6 +74,10 @@ static volatile _bcm2835_uart1_regs* pMiniUARTRegs = (_bcm2835_uart1_regs*)_BCM2
  */
 #define _BCM2735_UART1_BAUDRATE 270
 
+static miniuart_tx_handler s_tx_handler = NULL;
+static miniuart_rx_handler s_rx_handler = NULL;
+static uint32_t s_rx_overruns = 0;
+
 static void configure_miniuart() {
 	pMiniUARTRegs->AUX_MU_IER_REG = 0;
 	/* Disable RX/TX so we can configure the UART */
@@ -116,13 +103,24 @@ void bcm2835_miniuart_open() {
 	bcm2835_miniuart_enableTX(true);
 }
 
+/* Reading the line status clears the overrun bit, so every read goes through
+ * here to count it. Once the RX interrupt is running only the interrupt reads
+ * the line status. */
+static uint32_t read_line_status() {
+	uint32_t lsr = pMiniUARTRegs->AUX_MU_LSR_REG;
+	if (lsr & (1 << _BCM2835_LSR_RECV_OVERRUN)) {
+		s_rx_overruns++;
+	}
+	return lsr;
+}
+
 /* Returns true if transmitter FIFO can accept at least one byte */
 bool bcm2835_miniuart_is_transmitter_empty() {
-	return (pMiniUARTRegs->AUX_MU_LSR_REG & (1 << _BCM2835_LSR_TX_EMPTY)) ? true : false;
+	return (read_line_status() & (1 << _BCM2835_LSR_TX_EMPTY)) ? true : false;
 }
 
-bool is_data_ready() {
-	return (pMiniUARTRegs->AUX_MU_LSR_REG & (1 << _BCM2835_LSR_DATA_RDY)) ? true : false;
+bool bcm2835_miniuart_is_data_ready() {
+	return (read_line_status() & (1 << _BCM2835_LSR_DATA_RDY)) ? true : false;
 }
 
 void bcm2835_miniuart_sendchar(char c) {
@@ -150,7 +148,7 @@ void bcm2835_miniuart_send_blocking(const void *buf, size_t count) {
 }
 
 void bcm2835_miniuart_receivechar(char* c) {
-	while(!is_data_ready());
+	while(!bcm2835_miniuart_is_data_ready());
 	*c = pMiniUARTRegs->AUX_MU_IO_REG;
 }
 
@@ -158,12 +156,70 @@ void bcm2835_miniuart_receive_blocking(void *buf, size_t count) {
 	uint8_t* ptr = buf;
 	size_t actual = 0;
 	for(actual = 0; actual < count; actual++) {
-		while(!is_data_ready());
+		while(!bcm2835_miniuart_is_data_ready());
 		*ptr = pMiniUARTRegs->AUX_MU_IO_REG;
 		ptr++;
 	}
 }
 
+/* The mini UART shares the AUX interrupt with the two auxiliary SPI masters.
+ * The RX interrupt is asserted while the receive FIFO holds a byte, so each
+ * interrupt first empties it into the rx handler. The TX interrupt is asserted
+ * while the transmit FIFO is empty, so each interrupt then refills the FIFO
+ * with as many bytes as the handler can supply and switches itself off once
+ * the handler runs dry. */
+static void interrupt_handler(uint32_t nIRQ, void *pParam) {
+	char c;
+	if (!bcm2835_aux_pendingirq(_MINIUART)) {
+		return;
+	}
+	while (bcm2835_miniuart_is_data_ready()) {
+		c = pMiniUARTRegs->AUX_MU_IO_REG;
+		if (s_rx_handler != NULL) {
+			s_rx_handler(c);
+		}
+	}
+	if (!(pMiniUARTRegs->AUX_MU_IER_REG & (1 << _BCM2835_IER_TX_ENABLE))) {
+		return;
+	}
+	while (bcm2835_miniuart_is_transmitter_empty()) {
+		if (s_tx_handler == NULL || !s_tx_handler(&c)) {
+			bcm2835_miniuart_enableTXIRQ(false);
+			break;
+		}
+		pMiniUARTRegs->AUX_MU_IO_REG = c;
+	}
+}
+
+void bcm2835_miniuart_set_tx_handler(miniuart_tx_handler handler) {
+	s_tx_handler = handler;
+	bcm2835_irq_register(BCM2835_IRQ_ID_AUX, interrupt_handler, NULL);
+	bcm2835_irq_enable(BCM2835_IRQ_ID_AUX);
+}
+
+void bcm2835_miniuart_set_rx_handler(miniuart_rx_handler handler) {
+	s_rx_handler = handler;
+	bcm2835_irq_register(BCM2835_IRQ_ID_AUX, interrupt_handler, NULL);
+	bcm2835_irq_enable(BCM2835_IRQ_ID_AUX);
+	pMiniUARTRegs->AUX_MU_IER_REG |= (1 << _BCM2835_IER_RX_ENABLE) | _BCM2835_IER_RX_REQUIRED;
+}
+
+uint32_t bcm2835_miniuart_rx_overruns() {
+	return s_rx_overruns;
+}
+
+/* Only ever set from task level and cleared from the interrupt, so a clear
+ * racing with a set at worst causes one spurious interrupt which finds the
+ * handler empty and switches the TX interrupt off again. */
+void bcm2835_miniuart_enableTXIRQ(bool enable) {
+	volatile uint32_t* pReg = &pMiniUARTRegs->AUX_MU_IER_REG;
+	if (enable) {
+		*pReg |= (1 << _BCM2835_IER_TX_ENABLE);
+	} else {
+		*pReg &= ~(1 << _BCM2835_IER_TX_ENABLE);
+	}
+}
+
 void bcm2835_miniuart_enableRX(bool enable) {
 	volatile uint32_t* pReg = &pMiniUARTRegs->AUX_MU_CNTL_REG;
 	if (enable) {
@@ -11,6 +11,18 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+/**
+ * Called from the mini UART interrupt each time the transmitter can accept
+ * another byte. Returns false when there is nothing left to send.
+ */
+typedef bool (*miniuart_tx_handler)(char *c);
+
+/**
+ * Called from the mini UART interrupt for each byte taken from the receiver
+ * FIFO.
+ */
+typedef void (*miniuart_rx_handler)(char c);
+
 void bcm2835_miniuart_open();
 
 void bcm2835_miniuart_sendchar(char c);
@@ -29,4 +41,30 @@ void bcm2835_miniuart_enableTX(bool enable);
 
 bool bcm2835_miniuart_is_transmitter_empty();
 
+/* Returns true if the receiver FIFO holds at least one byte */
+bool bcm2835_miniuart_is_data_ready();
+
+/**
+ * Sets the function that supplies bytes to the interrupt driven transmitter
+ * and enables the AUX interrupt
+ */
+void bcm2835_miniuart_set_tx_handler(miniuart_tx_handler handler);
+
+/**
+ * Enables the transmitter empty interrupt. Enable it whenever new data is
+ * available to the tx handler, the interrupt disables itself once the
+ * handler has nothing left to send.
+ */
+void bcm2835_miniuart_enableTXIRQ(bool enable);
+
+/**
+ * Sets the function that takes the received bytes, enables the AUX interrupt
+ * and the receive interrupt. The receiver FIFO is drained by the interrupt
+ * from then on, so the blocking receive functions must not be used with it.
+ */
+void bcm2835_miniuart_set_rx_handler(miniuart_rx_handler handler);
+
+/* Number of times the receiver FIFO has overflowed and lost a byte */
+uint32_t bcm2835_miniuart_rx_overruns();
+
 #endif /* FREERTOS_DEMO_ARM6_BCM2835_DRIVERS_BCM2835_MINIUART_H_ */
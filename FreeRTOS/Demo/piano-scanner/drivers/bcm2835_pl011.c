@@ -0,0 +1,230 @@
+/*
+ * bcm2835_pl011.c
+ *
+ *  Description:
+ *  Interrupt driven driver for UART0, the ARM PL011, see
+ *  bcm2835_pl011.h
+ */
+
+#include "bcm2835_pl011.h"
+#include "bcm2835.h"
+#include "bcm2835_irq.h"
+#include "bcm2835_intc.h"
+
+#define _BCM2835_PL011_TX_PIN 14
+#define _BCM2835_PL011_RX_PIN 15
+
+#define _BCM2835_PL011_BASE 0x20201000
+
+#define _BCM2835_PL011_FIFO_BYTES 16
+
+typedef struct {
+	uint32_t DR; /* Data Register */
+	uint32_t RSRECR;
+	uint32_t reserved0; /* 0x08 */
+	uint32_t reserved1; /* 0x0C */
+	uint32_t reserved2; /* 0x10 */
+	uint32_t reserved3; /* 0x14 */
+	uint32_t FR; /* Flag Register */
+	uint32_t reserved4; /* 0x1C */
+	uint32_t ILPAR; /* Not used */
+	uint32_t IBRD; /* Integer Baud Rate Divisor */
+	uint32_t FBRD; /* Fractional Baud Rate Divisor */
+	uint32_t LCRH; /* Line Control Register */
+	uint32_t CR; /* Control Register */
+	uint32_t IFLS; /* Interrupt FIFO Level Select Register */
+	uint32_t IMSC; /* Interrupt Mask Set Register */
+	uint32_t RIS; /* Raw Interrupt Status Register */
+	uint32_t MIS; /* Masked Interrupt Status Register */
+	uint32_t ICR; /* Interrupt Clear Register */
+	uint32_t DMACR; /* DMA Control Register */
+	uint32_t ITCR; /* Test Control Register */
+	uint32_t ITIP; /* Integration Test Input Register */
+	uint32_t ITOP; /* Integration Test Output Register */
+	uint32_t TDR; /* Test Data Reg */
+} _bcm2835_uart0_regs;
+
+/* DR */
+#define _BCM2835_DR_OE 11
+
+/* FR */
+#define _BCM2835_FR_TXFE 7
+#define _BCM2835_FR_TXFF 5
+#define _BCM2835_FR_RXFE 4
+#define _BCM2835_FR_BUSY 3
+
+/* LCRH */
+#define _BCM2835_LCRH_WLEN_8 (3 << 5)
+#define _BCM2835_LCRH_FEN 4
+
+/* CR */
+#define _BCM2835_CR_RXE 9
+#define _BCM2835_CR_TXE 8
+#define _BCM2835_CR_UARTEN 0
+
+/* DMACR */
+#define _BCM2835_DMACR_TXDMAE 1
+
+/* IFLS */
+#define _BCM2835_IFLS_RXIFLSEL 3
+#define _BCM2835_IFLS_TXIFLSEL 0
+
+/* IMSC, RIS, MIS and ICR */
+#define _BCM2835_INT_OE 10
+#define _BCM2835_INT_RT 6
+#define _BCM2835_INT_TX 5
+#define _BCM2835_INT_RX 4
+#define _BCM2835_INT_ALL 0x7FF
+
+#define _BCM2835_INT_RX_ALL ((1 << _BCM2835_INT_RX) | (1 << _BCM2835_INT_RT) | (1 << _BCM2835_INT_OE))
+
+static volatile _bcm2835_uart0_regs* pUART0Regs = (_bcm2835_uart0_regs*)_BCM2835_PL011_BASE;
+
+static pl011_tx_handler s_tx_handler = NULL;
+static pl011_rx_handler s_rx_handler = NULL;
+static uint32_t s_tx_batch = _BCM2835_PL011_FIFO_BYTES;
+static uint32_t s_rx_overruns = 0;
+
+void bcm2835_pl011_open(uint32_t baud, uint32_t clock_hz) {
+	/* Disable the UART and let the byte on the line finish */
+	pUART0Regs->CR = 0;
+	while (pUART0Regs->FR & (1 << _BCM2835_FR_BUSY));
+	/* Clearing FEN flushes the transmit FIFO */
+	pUART0Regs->LCRH = 0;
+
+	bcm2835_gpio_fsel(_BCM2835_PL011_TX_PIN, BCM2835_GPIO_FSEL_ALT0);
+	bcm2835_gpio_fsel(_BCM2835_PL011_RX_PIN, BCM2835_GPIO_FSEL_ALT0);
+
+	/* Baud rate divisor = UARTCLK / (16 * baud), in 1/64ths. From 48MHz
+	 * 31250 baud is exactly 96 and 115200 is 26 3/64 (-0.02%); from 3MHz
+	 * they are exactly 6 and 1 40/64 (+0.16%) */
+	uint32_t divisor = (clock_hz * 4 + baud / 2) / baud;
+	pUART0Regs->ICR = _BCM2835_INT_ALL;
+	pUART0Regs->IMSC = 0;
+	pUART0Regs->IBRD = divisor >> 6;
+	pUART0Regs->FBRD = divisor & 0x3F;
+	/* LCRH must be written after the divisors to latch them */
+	pUART0Regs->LCRH = _BCM2835_LCRH_WLEN_8 | (1 << _BCM2835_LCRH_FEN);
+	bcm2835_pl011_set_fifo(BCM2835_PL011_FIFO_1_8, _BCM2835_PL011_FIFO_BYTES, BCM2835_PL011_FIFO_1_2);
+	pUART0Regs->CR = (1 << _BCM2835_CR_UARTEN) | (1 << _BCM2835_CR_TXE) | (1 << _BCM2835_CR_RXE);
+}
+
+void bcm2835_pl011_set_fifo(bcm2835_pl011_fifo_level tx_level, uint32_t tx_batch, bcm2835_pl011_fifo_level rx_level) {
+	static const uint8_t level_bytes[] = { 2, 4, 8, 12, 14 };
+	if (tx_batch <= level_bytes[tx_level]) {
+		tx_batch = level_bytes[tx_level] + 1;
+	}
+	if (tx_batch > _BCM2835_PL011_FIFO_BYTES) {
+		tx_batch = _BCM2835_PL011_FIFO_BYTES;
+	}
+	s_tx_batch = tx_batch;
+	pUART0Regs->IFLS = (rx_level << _BCM2835_IFLS_RXIFLSEL) | (tx_level << _BCM2835_IFLS_TXIFLSEL);
+}
+
+bool bcm2835_pl011_is_data_ready() {
+	return (pUART0Regs->FR & (1 << _BCM2835_FR_RXFE)) ? false : true;
+}
+
+void bcm2835_pl011_send_blocking(const void *buf, size_t count) {
+	const uint8_t* ptr = buf;
+	size_t actual = 0;
+	for(actual = 0; actual < count; actual++) {
+		while(pUART0Regs->FR & (1 << _BCM2835_FR_TXFF));
+		pUART0Regs->DR = *ptr;
+		ptr++;
+	}
+}
+
+void bcm2835_pl011_receive_blocking(void *buf, size_t count) {
+	uint8_t* ptr = buf;
+	size_t actual = 0;
+	for(actual = 0; actual < count; actual++) {
+		while(!bcm2835_pl011_is_data_ready());
+		*ptr = pUART0Regs->DR;
+		ptr++;
+	}
+}
+
+/* Queues up to one batch from the tx handler. Returns false once the
+ * handler runs dry. A batch is always more than the transmit level, so
+ * unless the handler runs dry the FIFO ends above the level and the
+ * interrupt is raised again when it drains back to it. */
+static bool fill_tx_fifo() {
+	char c;
+	for (uint32_t queued = 0; queued < s_tx_batch; queued++) {
+		if (pUART0Regs->FR & (1 << _BCM2835_FR_TXFF)) {
+			break;
+		}
+		if (s_tx_handler == NULL || !s_tx_handler(&c)) {
+			return false;
+		}
+		pUART0Regs->DR = c;
+	}
+	return true;
+}
+
+/* The receive interrupt is raised at the receive level and the receive
+ * timeout once the line has been quiet with bytes left below it, so
+ * either way the FIFO is emptied into the rx handler. */
+static void interrupt_handler(uint32_t nIRQ, void *pParam) {
+	uint32_t status = pUART0Regs->MIS;
+	if (status & _BCM2835_INT_RX_ALL) {
+		while (bcm2835_pl011_is_data_ready()) {
+			uint32_t data = pUART0Regs->DR;
+			if (data & (1 << _BCM2835_DR_OE)) {
+				s_rx_overruns++;
+			}
+			if (s_rx_handler != NULL) {
+				s_rx_handler(data & 0xFF);
+			}
+		}
+		pUART0Regs->ICR = _BCM2835_INT_RX_ALL;
+	}
+	if ((status & (1 << _BCM2835_INT_TX)) && !fill_tx_fifo()) {
+		pUART0Regs->IMSC &= ~(1 << _BCM2835_INT_TX);
+	}
+}
+
+void bcm2835_pl011_set_tx_handler(pl011_tx_handler handler) {
+	s_tx_handler = handler;
+	bcm2835_irq_register(BCM2835_IRQ_ID_UART, interrupt_handler, NULL);
+	bcm2835_irq_enable(BCM2835_IRQ_ID_UART);
+}
+
+/* The transmit interrupt is raised by the FIFO draining through its
+ * level, not by it being below it, so turning the interrupt on with the
+ * FIFO already empty would never raise it. Filling the FIFO here first
+ * guarantees that crossing. Interrupts are masked so the tx handler is
+ * never entered from here and the interrupt at once. */
+void bcm2835_pl011_start_tx() {
+	uint32_t cpsr = bcm2835_irq_save();
+	if (!(pUART0Regs->IMSC & (1 << _BCM2835_INT_TX)) && fill_tx_fifo()) {
+		pUART0Regs->IMSC |= (1 << _BCM2835_INT_TX);
+	}
+	bcm2835_irq_restore(cpsr);
+}
+
+void bcm2835_pl011_set_rx_handler(pl011_rx_handler handler) {
+	s_rx_handler = handler;
+	bcm2835_irq_register(BCM2835_IRQ_ID_UART, interrupt_handler, NULL);
+	bcm2835_irq_enable(BCM2835_IRQ_ID_UART);
+	uint32_t cpsr = bcm2835_irq_save();
+	pUART0Regs->IMSC |= _BCM2835_INT_RX_ALL;
+	bcm2835_irq_restore(cpsr);
+}
+
+uint32_t bcm2835_pl011_rx_overruns() {
+	return s_rx_overruns;
+}
+
+void bcm2835_pl011_enable_tx_dma(bool enable) {
+	if (enable) {
+		pUART0Regs->DMACR |= (1 << _BCM2835_DMACR_TXDMAE);
+	} else {
+		pUART0Regs->DMACR &= ~(1 << _BCM2835_DMACR_TXDMAE);
+	}
+}
+
+void bcm2835_pl011_dma_tx_cb(bcm2835_dma_cb *cb, const uint32_t *words, uint32_t count) {
+	bcm2835_dma_cb_to_peripheral(cb, &pUART0Regs->DR, words, count * sizeof(uint32_t), BCM2835_DMA_DREQ_UART_TX);
+}
@@ -0,0 +1,109 @@
+/*
+ * bcm2835_pl011.h
+ *
+ *  Description:
+ *  Interrupt driven driver for UART0, the ARM PL011. Unlike the mini
+ *  UART it is clocked from its own reference (UARTCLK, set by the firmware's
+ *  init_uart_clock, 48MHz unless config.txt changes it) rather than the core
+ *  clock, so its baud rate does not move with the core clock, and 31250 baud
+ *  for DIN midi divides exactly from 3MHz or 48MHz.
+ *  It has 16 byte transmit and receive FIFOs, which the interrupt fills
+ *  and empties in batches. It takes GPIO 14 and 15 (alternate function
+ *  0), the same pins as the mini UART, so only one of them can be open.
+ */
+
+#ifndef _BCM2835_PL011_H_
+#define _BCM2835_PL011_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "bcm2835_dma.h"
+
+/* FIFO interrupt levels, in eighths of the 16 byte FIFOs */
+typedef enum {
+	BCM2835_PL011_FIFO_1_8 = 0,
+	BCM2835_PL011_FIFO_1_4 = 1,
+	BCM2835_PL011_FIFO_1_2 = 2,
+	BCM2835_PL011_FIFO_3_4 = 3,
+	BCM2835_PL011_FIFO_7_8 = 4
+} bcm2835_pl011_fifo_level;
+
+/**
+ * Called from the UART0 interrupt each time the transmitter can accept
+ * another byte. Returns false when there is nothing left to send.
+ */
+typedef bool (*pl011_tx_handler)(char *c);
+
+/**
+ * Called from the UART0 interrupt for each byte taken from the receive
+ * FIFO.
+ */
+typedef void (*pl011_rx_handler)(char c);
+
+/**
+ * Takes over GPIO 14 and 15 and sets 8N1 with the FIFOs on at the baud
+ * rate nearest to baud that UARTCLK gives. clock_hz has to match the
+ * firmware's init_uart_clock, the driver cannot read it back.
+ */
+void bcm2835_pl011_open(uint32_t baud, uint32_t clock_hz);
+
+/**
+ * The transmit interrupt is raised when the transmit FIFO drains to
+ * tx_level, and each one queues at most tx_batch more bytes, so there
+ * are never more than tx_level + tx_batch bytes in front of a new one.
+ * tx_batch is raised to one more than tx_level if it is less. The
+ * receive interrupt is raised when the receive FIFO fills to rx_level,
+ * or 32 bit periods after the last byte if it holds fewer.
+ */
+void bcm2835_pl011_set_fifo(bcm2835_pl011_fifo_level tx_level, uint32_t tx_batch, bcm2835_pl011_fifo_level rx_level);
+
+void bcm2835_pl011_send_blocking(const void *buf, size_t count);
+
+void bcm2835_pl011_receive_blocking(void *buf, size_t count);
+
+/* Returns true if the receive FIFO holds at least one byte */
+bool bcm2835_pl011_is_data_ready();
+
+/**
+ * Sets the function that supplies bytes to the interrupt driven
+ * transmitter and enables the UART0 interrupt
+ */
+void bcm2835_pl011_set_tx_handler(pl011_tx_handler handler);
+
+/**
+ * Call whenever new data is available to the tx handler. The transmit
+ * interrupt only fires when the FIFO drains past its level, so if it is
+ * off this fills the FIFO from the handler itself, with interrupts
+ * disabled, and turns it on. The interrupt turns itself off once the
+ * handler has nothing left to send.
+ */
+void bcm2835_pl011_start_tx();
+
+/**
+ * Sets the function that takes the received bytes and enables the UART0
+ * interrupt and the receive interrupts. The receive FIFO is emptied by
+ * the interrupt from then on, so the blocking receive must not be used
+ * with it.
+ */
+void bcm2835_pl011_set_rx_handler(pl011_rx_handler handler);
+
+/* Number of bytes lost to the receive FIFO being full */
+uint32_t bcm2835_pl011_rx_overruns();
+
+/**
+ * Turns the transmit DMA request on or off. With it on a DMA channel
+ * paced by BCM2835_DMA_DREQ_UART_TX keeps the transmit FIFO topped up.
+ * The tx handler must be held off while a transfer runs, the two would
+ * interleave their bytes.
+ */
+void bcm2835_pl011_enable_tx_dma(bool enable);
+
+/**
+ * Fills a control block sending count bytes, one to each 32 bit word of
+ * words: the engine only moves whole words and the data register takes
+ * the low byte of each.
+ */
+void bcm2835_pl011_dma_tx_cb(bcm2835_dma_cb *cb, const uint32_t *words, uint32_t count);
+
+#endif /* _BCM2835_PL011_H_ */
@@ -0,0 +1,41 @@
+/*
+ * bcm2835_spi_shiftreg.c
+ *
+ *  Description:
+ *  Drives a chain of 74HC595 shift registers from SPI0, see
+ *  bcm2835_spi_shiftreg.h
+ */
+
+#include "bcm2835_spi_shiftreg.h"
+#include "bcm2835.h"
+
+void bcm2835_spi_shiftreg_init(uint16_t divider) {
+	bcm2835_spi_begin();
+	bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);
+	bcm2835_spi_setClockDivider(divider);
+	bcm2835_spi_chipSelect(BCM2835_SPI_CS0);
+	bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);
+}
+
+/* A cut down bcm2835_spi_writenb(). The word is at most 4 bytes and the
+ * fifo holds 16, so it all goes in without polling TXD, and the received
+ * bytes are left in the rx fifo to be cleared by the next write. */
+void bcm2835_spi_shiftreg_write(uint32_t word, uint32_t bytes) {
+	volatile uint32_t* paddr = bcm2835_spi0 + BCM2835_SPI0_CS/4;
+	volatile uint32_t* fifo = bcm2835_spi0 + BCM2835_SPI0_FIFO/4;
+	uint32_t cs = bcm2835_peri_read_nb(paddr) & ~(BCM2835_SPI0_CS_TA | BCM2835_SPI0_CS_CLEAR);
+
+	/* Clear the fifos and set TA = 1, asserting CE0 */
+	bcm2835_peri_write_nb(paddr, cs | BCM2835_SPI0_CS_CLEAR | BCM2835_SPI0_CS_TA);
+
+	while (bytes--) {
+		bcm2835_peri_write_nb(fifo, (word >> (bytes * 8)) & 0xFF);
+	}
+
+	/* Wait for DONE to be set */
+	while (!(bcm2835_peri_read_nb(paddr) & BCM2835_SPI0_CS_DONE))
+		;
+
+	/* Set TA = 0, CE0 rises and latches the chain */
+	bcm2835_peri_write(paddr, cs);
+}
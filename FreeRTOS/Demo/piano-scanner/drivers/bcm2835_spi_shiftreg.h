@@ -0,0 +1,30 @@
+/*
+ * bcm2835_spi_shiftreg.h
+ *
+ *  Description:
+ *  Drives a chain of 74HC595 shift registers from SPI0. The chain's
+ *  serial data, shift clock and storage (latch) clock are wired to
+ *  MOSI (GPIO 10), SCLK (GPIO 11) and CE0 (GPIO 8). A write sends the
+ *  whole output word in one transfer, CE0 rising at its end latches
+ *  it onto the outputs.
+ */
+
+#ifndef _BCM2835_SPI_SHIFTREG_H_
+#define _BCM2835_SPI_SHIFTREG_H_
+
+#include <stdint.h>
+
+/**
+ * Takes over the SPI0 pins and sets mode 0, CE0 active low and the
+ * core clock divider
+ */
+void bcm2835_spi_shiftreg_init(uint16_t divider);
+
+/**
+ * Shifts the low bytes * 8 bits of word into the chain, most significant
+ * bit first, and latches them. Returns once the outputs have changed.
+ * Safe from interrupt context as long as nothing else uses SPI0.
+ */
+void bcm2835_spi_shiftreg_write(uint32_t word, uint32_t bytes);
+
+#endif /* _BCM2835_SPI_SHIFTREG_H_ */
@@ -39,7 +39,8 @@ bool bcm2835_systimer_matched(e_bcm2835_timers timer) {
 
 void bcm2835_systimer_clear(e_bcm2835_timers timer) {
 	uint32_t mask = (1 << timer);
-	pSysTimerRegs->CS |= mask;
+	/* Write 1 to clear, a read-modify-write would clear the other matches too */
+	pSysTimerRegs->CS = mask;
 }
 
 void bcm2835_set_handler(e_bcm2835_timers timer, timer_irq_handler handler) {
@@ -48,40 +49,53 @@ void bcm2835_set_handler(e_bcm2835_timers timer, timer_irq_handler handler) {
 	}
 }
 
+/* The next compare is advanced from the previous one rather than from the
+ * counter so that the interrupt latency does not stretch the period. If the
+ * interrupt was serviced so late that the match is already in the past, restart
+ * from the counter instead of waiting for the 32 bit counter to wrap. */
+static uint32_t next_compare(uint32_t compare, uint32_t interval) {
+	uint32_t next = compare + interval;
+	uint32_t now = pSysTimerRegs->CLO;
+	if ((int32_t)(next - now) <= 0) {
+		next = now + interval;
+	}
+	return next;
+}
+
 static void interrupt_handler(uint32_t nIRQ, void *pParam) {
 	switch(nIRQ) {
 	case IRQ_SYSTIMER_0:
-		/* Set timer nb tick in front of current value */
-		pSysTimerRegs->C0 = (pSysTimerRegs->CLO + s_systimers_intervals[0]) % 0xFFFFFFFF;
+		/* Set timer nb tick in front of the previous compare value */
+		pSysTimerRegs->C0 = next_compare(pSysTimerRegs->C0, s_systimers_intervals[0]);
 		/* Clear timer */
-		pSysTimerRegs->CS |= (1 << _SYSTIMER0);
+		pSysTimerRegs->CS = (1 << _SYSTIMER0);
 		if (handlers[0] != NULL) {
 			handlers[0](0);
 		}
 		break;
 	case IRQ_SYSTIMER_1:
-		/* Set timer nb tick in front of current value */
-		pSysTimerRegs->C1 = (pSysTimerRegs->CLO + s_systimers_intervals[1]) % 0xFFFFFFFF;
+		/* Set timer nb tick in front of the previous compare value */
+		pSysTimerRegs->C1 = next_compare(pSysTimerRegs->C1, s_systimers_intervals[1]);
 		/* Clear timer */
-		pSysTimerRegs->CS |= (1 << _SYSTIMER1);
+		pSysTimerRegs->CS = (1 << _SYSTIMER1);
 		if (handlers[1] != NULL) {
 			handlers[1](1);
 		}
 		break;
 	case IRQ_SYSTIMER_2:
-		/* Set timer nb tick in front of current value */
-		pSysTimerRegs->C2 = (pSysTimerRegs->CLO + s_systimers_intervals[2]) % 0xFFFFFFFF;
+		/* Set timer nb tick in front of the previous compare value */
+		pSysTimerRegs->C2 = next_compare(pSysTimerRegs->C2, s_systimers_intervals[2]);
 		/* Clear timer */
-		pSysTimerRegs->CS |= (1 << _SYSTIMER2);
+		pSysTimerRegs->CS = (1 << _SYSTIMER2);
 		if (handlers[2] != NULL) {
 			handlers[2](2);
 		}
 		break;
 	case IRQ_SYSTIMER_3:
-		/* Set timer nb tick in front of current value */
-		pSysTimerRegs->C3 = (pSysTimerRegs->CLO + s_systimers_intervals[3]) % 0xFFFFFFFF;
+		/* Set timer nb tick in front of the previous compare value */
+		pSysTimerRegs->C3 = next_compare(pSysTimerRegs->C3, s_systimers_intervals[3]);
 		/* Clear timer */
-		pSysTimerRegs->CS |= (1 << _SYSTIMER3);
+		pSysTimerRegs->CS = (1 << _SYSTIMER3);
 		if (handlers[3] != NULL) {
 			handlers[3](3);
 		}
@@ -12,6 +12,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include "bcm2835_miniuart.h"
+#include "libc_functions.h"
 
 #ifdef __DEBUG_LIBC_FUNCS__
 #include <stdio.h>
@@ -22,6 +23,17 @@ char buffer[80];
 extern caddr_t _heap_start_addr;
 caddr_t* _heap_start = &_heap_start_addr;
 
+static libc_write_handler write_handler = NULL;
+static libc_read_handler read_handler = NULL;
+
+void libc_set_write_handler(libc_write_handler handler) {
+	write_handler = handler;
+}
+
+void libc_set_read_handler(libc_read_handler handler) {
+	read_handler = handler;
+}
+
 /* Write cnt byte from the buffer buf to the stream associated
  * with the file descriptor fd. */
 int _write (int fd, const void *buf, size_t count) {
@@ -29,6 +41,9 @@ int _write (int fd, const void *buf, size_t count) {
 	sprintf(buffer, "_write count %d\n\r", count);
 	bcm2835_miniuart_sendstr(buffer);
 #endif
+	if (write_handler != NULL) {
+		return write_handler(fd, buf, count);
+	}
 	bcm2835_miniuart_send_blocking(buf, count);
 	/* We assume we wrote everything */
 	return count;
@@ -37,6 +52,9 @@ int _write (int fd, const void *buf, size_t count) {
 /* Read cnt byte from the stream associated with the file
  * descriptor fd and put them into the buffer buf. */
 int _read (int fd, void *buf, size_t count) {
+	if (read_handler != NULL) {
+		return read_handler(fd, buf, count);
+	}
 	bcm2835_miniuart_receive_blocking(buf, count);
 	return count;
 }
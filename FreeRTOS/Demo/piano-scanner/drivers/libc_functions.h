@@ -0,0 +1,30 @@
+/*
+ * libc_functions.h
+ *
+ *  Description: Hooks into the libc system calls of libc_functions.c
+ */
+
+#ifndef _LIBC_FUNCTIONS_H_
+#define _LIBC_FUNCTIONS_H_
+
+#include <stdlib.h>
+
+typedef int (*libc_write_handler)(int fd, const void *buf, size_t count);
+typedef int (*libc_read_handler)(int fd, void *buf, size_t count);
+
+/**
+ * Sends everything written through _write (printf and the rest of stdio)
+ * to handler instead of the blocking mini UART send. NULL goes back to
+ * the blocking send, which is all that works before the scheduler and the
+ * interrupts are running.
+ */
+void libc_set_write_handler(libc_write_handler handler);
+
+/**
+ * Takes everything read through _read (scanf, getchar and the rest of stdio)
+ * from handler instead of spinning on the mini UART receiver. NULL goes back
+ * to the blocking receive.
+ */
+void libc_set_read_handler(libc_read_handler handler);
+
+#endif /* _LIBC_FUNCTIONS_H_ */
@@ -0,0 +1,260 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "piano_scanner.h"
+#include "ps_output.h"
+#include "ps_pins.h"
+
+// Models of the hardware behind ps_hal.h.
+//
+// Shift registers: three 74HC595 daisy chained as a 24 bit register. Data is
+// shifted in on the rising edge of the clock, the reset line (active low) clears
+// the shift stage and the rising edge of the latch copies the shift stage to
+// the outputs. Output n energises half bank n. Driven from SPI0 the word is
+// shifted in most significant bit first and the chip enable rising at the end
+// of the transfer latches it.
+//
+// Keys: each key has a make (switch 0) and break (switch 1) contact, each with a
+// list of closure intervals. A bank read returns the keys whose contact on the
+// energised line is closed at the current time, on the gpios of the key input
+// lines (ps_pins.h). Time only moves forward between resets so each contact
+// keeps a cursor into its list. The rising edge detect
+// of the key inputs reports a contact that has been closed at any time since
+// the last clear while its line was energised; it has to be read before the
+// level, which moves the cursor on past closures that have ended.
+//
+// Uart: bytes are pulled from ps_output_next_byte() one at a time at the
+// line rate, exactly as the tx interrupt does on the Pi.
+
+#define PS_HOST_OUTPUTS PS_SHIFT_REG_OUTPUTS
+#define PS_HOST_OUTPUT_MASK ((1u << PS_HOST_OUTPUTS) - 1)
+
+typedef struct
+{
+    uint32_t from[PS_HOST_MAX_CLOSURES];
+    uint32_t to[PS_HOST_MAX_CLOSURES];
+    uint32_t count;
+    uint32_t cursor;
+} ps_host_contact_t;
+
+static ps_host_contact_t contacts[PS_NUMBER_OF_KEYS][2];
+
+static uint32_t pin_levels;
+static uint32_t edges_cleared_us;
+static uint32_t shift_stage;
+static uint32_t outputs;
+
+static uint64_t now_ns;
+
+// the byte on the line and when its stop bit ends
+static bool uart_busy;
+static uint8_t uart_byte;
+static uint64_t uart_done_ns;
+static ps_host_midi_handler midi_handler;
+
+#define PS_HOST_UART_BYTE_NS (1000000000ull * PS_HOST_UART_BITS_PER_BYTE / PS_HOST_UART_BAUD)
+
+void ps_host_reset(uint32_t start_time_us)
+{
+    memset(contacts, 0, sizeof(contacts));
+    pin_levels = 0;
+    shift_stage = 0;
+    outputs = 0;
+    now_ns = (uint64_t)start_time_us * 1000;
+    edges_cleared_us = start_time_us;
+    uart_busy = false;
+}
+
+// A latch edge in the same store as a clock edge copies the shift stage from
+// before the shift, as a 74HC595 with its two clocks tied together does
+void ps_host_gpio_write(uint32_t mask, bool level)
+{
+    uint32_t rising = level ? mask & ~pin_levels : 0;
+    pin_levels = level ? pin_levels | mask : pin_levels & ~mask;
+    uint32_t stage = shift_stage;
+
+    if (!(pin_levels & PS_SHIFT_REG_RESET_MASK))
+    {
+        shift_stage = 0;
+    }
+    else if (rising & PS_SHIFT_REG_CLOCK_MASK)
+    {
+        shift_stage = ((shift_stage << 1) | !!(pin_levels & PS_SHIFT_REG_INPUT_MASK)) & PS_HOST_OUTPUT_MASK;
+    }
+    if (rising & PS_SHIFT_REG_LATCH_MASK)
+    {
+        outputs = stage;
+    }
+}
+
+void ps_host_shift_reg_write(uint32_t word)
+{
+    for (int bit = PS_HOST_OUTPUTS - 1; bit >= 0; bit--)
+    {
+        shift_stage = ((shift_stage << 1) | ((word >> bit) & 1)) & PS_HOST_OUTPUT_MASK;
+    }
+    outputs = shift_stage;
+}
+
+int ps_host_outputs_energised(void)
+{
+    return __builtin_popcount(outputs);
+}
+
+static bool ps_host_contact_closed(ps_host_contact_t *contact)
+{
+    uint32_t now_us = ps_host_time_us();
+    while (contact->cursor < contact->count && (int32_t)(now_us - contact->to[contact->cursor]) >= 0)
+    {
+        contact->cursor++;
+    }
+    return contact->cursor < contact->count && (int32_t)(now_us - contact->from[contact->cursor]) >= 0;
+}
+
+// Whether a contact has been closed at any time since since_us
+static bool ps_host_contact_closed_since(ps_host_contact_t *contact, uint32_t since_us)
+{
+    uint32_t now_us = ps_host_time_us();
+    for (uint32_t i = contact->cursor; i < contact->count && (int32_t)(now_us - contact->from[i]) >= 0; i++)
+    {
+        if ((int32_t)(contact->to[i] - since_us) > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The keys of the energised half bank whose contact is closed now, or with
+// edges, has been closed since the edges were last cleared
+static ps_bank_bits_t ps_host_bank_bits(bool edges)
+{
+    ps_bank_bits_t bits = 0;
+    for (int output = 0; output < PS_NUMBER_OF_KEY_BANKS * 2; output++)
+    {
+        if (!(outputs & (1u << output)))
+        {
+            continue;
+        }
+        int bank = output / 2;
+        for (int position = 0; position < PS_NUMBER_OF_KEYS_PER_BANK; position++)
+        {
+            int key = bank * PS_NUMBER_OF_KEYS_PER_BANK + position;
+            if (key >= PS_NUMBER_OF_KEYS)
+            {
+                continue;
+            }
+            ps_host_contact_t *contact = &contacts[key][output & 1];
+            if (edges ? ps_host_contact_closed_since(contact, edges_cleared_us) : ps_host_contact_closed(contact))
+            {
+                bits |= 1u << position;
+            }
+        }
+    }
+    return bits;
+}
+
+// Puts the key input lines of a bank word on their gpios in a register
+static uint32_t ps_host_register_bits(int reg, ps_bank_bits_t bits)
+{
+    uint32_t value = 0;
+    for (int line = 0; line < PS_NUMBER_OF_KEYS_PER_BANK; line++)
+    {
+        uint8_t gpio = ps_key_input_gpios[line];
+        if (gpio / 32 == reg && (bits & (1u << line)))
+        {
+            value |= 1u << (gpio % 32);
+        }
+    }
+    return value;
+}
+
+uint32_t ps_host_read_events(int reg)
+{
+    return ps_host_register_bits(reg, ps_host_bank_bits(true));
+}
+
+// Only the key inputs are modelled, so the edges of every key input are
+// cleared together
+void ps_host_clear_events(int reg, uint32_t mask)
+{
+    (void)reg;
+    (void)mask;
+    edges_cleared_us = ps_host_time_us();
+}
+
+uint32_t ps_host_read_levels(int reg)
+{
+    return ps_host_register_bits(reg, ps_host_bank_bits(false));
+}
+
+bool ps_host_add_closure(int key, int sw, uint32_t from_us, uint32_t to_us)
+{
+    if (key < 0 || key >= PS_NUMBER_OF_KEYS || sw < 0 || sw > 1)
+    {
+        return false;
+    }
+    ps_host_contact_t *contact = &contacts[key][sw];
+    if (contact->count == PS_HOST_MAX_CLOSURES)
+    {
+        return false;
+    }
+
+    // keep the list ordered by closing time
+    uint32_t i = contact->count++;
+    while (i > contact->cursor && (int32_t)(contact->from[i - 1] - from_us) > 0)
+    {
+        contact->from[i] = contact->from[i - 1];
+        contact->to[i] = contact->to[i - 1];
+        i--;
+    }
+    contact->from[i] = from_us;
+    contact->to[i] = to_us;
+    return true;
+}
+
+uint32_t ps_host_time_us(void)
+{
+    return (uint32_t)(now_ns / 1000);
+}
+
+void ps_host_set_midi_handler(ps_host_midi_handler handler)
+{
+    midi_handler = handler;
+}
+
+// Puts the next queued byte on the line, as the tx interrupt does whenever the
+// transmitter empties
+static void ps_host_uart_next_byte(void)
+{
+    char c;
+    uart_busy = ps_output_next_byte(&c);
+    if (uart_busy)
+    {
+        uart_byte = (uint8_t)c;
+        uart_done_ns = now_ns + PS_HOST_UART_BYTE_NS;
+    }
+}
+
+void ps_host_uart_tx_start(void)
+{
+    if (!uart_busy)
+    {
+        ps_host_uart_next_byte();
+    }
+}
+
+void ps_host_advance_us(uint32_t us)
+{
+    uint64_t end_ns = now_ns + (uint64_t)us * 1000;
+    while (uart_busy && uart_done_ns <= end_ns)
+    {
+        now_ns = uart_done_ns;
+        if (midi_handler)
+        {
+            midi_handler(uart_byte, ps_host_time_us());
+        }
+        ps_host_uart_next_byte();
+    }
+    now_ns = end_ns;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Linux simulator backend for ps_hal.h. The shift register chain, the key
+// switches, the microsecond timer and the midi uart are modelled in
+// ps_hal_host.c. Time only moves when the simulator calls ps_host_advance_us().
+
+void ps_host_gpio_write(uint32_t mask, bool level);
+void ps_host_shift_reg_write(uint32_t word);
+uint32_t ps_host_read_levels(int reg);
+uint32_t ps_host_read_events(int reg);
+void ps_host_clear_events(int reg, uint32_t mask);
+uint32_t ps_host_time_us(void);
+void ps_host_uart_tx_start(void);
+
+#define GPIO_SET_PINS(mask) ps_host_gpio_write(mask, true)
+#define GPIO_CLR_PINS(mask) ps_host_gpio_write(mask, false)
+#define SHIFT_REG_WRITE(outputs) ps_host_shift_reg_write(outputs)
+#define GPIO_READ_LEVELS(reg) ps_host_read_levels(reg)
+#define GPIO_READ_EVENTS(reg) ps_host_read_events(reg)
+#define GPIO_CLEAR_EVENTS(reg, mask) ps_host_clear_events(reg, mask)
+#define READ_U32BIT_US_TIME() ps_host_time_us()
+#define RUN_LED_ON() do { } while (0)
+#define RUN_LED_OFF() do { } while (0)
+#define UART_TX_START() ps_host_uart_tx_start()
+#define SUSPEND_TASKS() do { } while (0)
+#define RESUME_TASKS() do { } while (0)
+#define ENTER_CRITICAL() do { } while (0)
+#define EXIT_CRITICAL() do { } while (0)
+#define TASK_DELAY_MS(ms) ps_host_advance_us((ms) * 1000)
+
+// Most make or break closures a single switch can be given between resets
+#define PS_HOST_MAX_CLOSURES 256
+
+// Uart model: 115200 baud, 8N1
+#define PS_HOST_UART_BAUD 115200
+#define PS_HOST_UART_BITS_PER_BYTE 10
+
+typedef void (*ps_host_midi_handler)(uint8_t byte, uint32_t time_us);
+
+// Clears all switch closures, the shift registers and the uart, and sets the
+// clock to start_time_us
+void ps_host_reset(uint32_t start_time_us);
+
+// Close a key's make (switch 0) or break (switch 1) contact for [from_us, to_us)
+bool ps_host_add_closure(int key, int sw, uint32_t from_us, uint32_t to_us);
+
+// Moves the clock on, sending any queued midi bytes the uart gets through
+// in that time
+void ps_host_advance_us(uint32_t us);
+
+// Called for every byte the uart model finishes sending
+void ps_host_set_midi_handler(ps_host_midi_handler handler);
+
+// Number of shift register outputs currently driven high. Anything other
+// than 1 while scanning means the chain has been clocked wrongly.
+int ps_host_outputs_energised(void);
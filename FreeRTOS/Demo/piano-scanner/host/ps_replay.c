@@ -0,0 +1,582 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "piano_scanner.h"
+#include "ps_velocity.h"
+#include "host/ps_sim.h"
+
+// Replays switch traces through the scanner in the simulator and compares the
+// midi that comes out of the uart model with what was played.
+//
+// Every stroke in a trace is ground truth: the note-on is due when the break
+// contact closes, with the velocity the selected curve gives for the exact make
+// to break time, and the note-off is due when the make contact opens, with the
+// release velocity for the exact break to make time as the key rises. Received
+// notes are matched to the earliest unmatched stroke on the same note within
+// PS_REPLAY_MATCH_WINDOW_US; anything left over is a missed or ghost note.
+// Notes with a high resolution velocity prefix are checked against the exact
+// 14 bit velocity; velocity errors are always in 7 bit velocity steps.
+//
+//   ps_replay               runs the built in scenarios
+//   ps_replay trace.txt     also runs a trace file
+//
+// Trace file lines (times in us, # starts a comment):
+//   <key> <press> <travel> <release> <release travel>   a stroke, see ps_sim_key_stroke()
+//   bounce <key> <switch> <from> <to>                   an extra contact closure,
+//                                                       switch 0 make, 1 break
+//
+// The exit status is 1 if any scenario missed or invented a note, the staccato
+// scenario excepted.
+
+#define PS_REPLAY_MAX_STROKES 2048
+#define PS_REPLAY_MAX_EVENTS (PS_REPLAY_MAX_STROKES * 4)
+#define PS_REPLAY_MATCH_WINDOW_US 20000
+// Run on this long after the last stroke so the uart empties
+#define PS_REPLAY_TAIL_US 100000
+
+typedef struct
+{
+    int key;
+    uint32_t press;
+    uint32_t travel;
+    uint32_t release;
+    uint32_t release_travel;
+    bool on_matched;
+    bool off_matched;
+} ps_replay_stroke_t;
+
+typedef struct
+{
+    uint32_t time;
+    uint8_t note;
+    uint8_t velocity;
+    bool on;
+    bool high_res;
+    uint16_t fine_velocity;
+} ps_replay_event_t;
+
+typedef struct
+{
+    uint32_t notes;
+    uint32_t missed;
+    uint32_t ghosts;
+    uint32_t missed_offs;
+    uint32_t ghost_offs;
+    int32_t latency_min;
+    int32_t latency_max;
+    int64_t latency_sum;
+    uint32_t latencies;
+    double velocity_error_max;
+    double velocity_error_sum;
+    uint32_t offs;
+    double release_error_max;
+    double release_error_sum;
+    uint32_t midi_bytes;
+    uint32_t passes;
+    uint64_t scan_ns;
+} ps_replay_result_t;
+
+static ps_replay_stroke_t strokes[PS_REPLAY_MAX_STROKES];
+static int stroke_count;
+static uint32_t trace_end;
+// strokes pressed and notes received before this are played but not scored
+static uint32_t score_from;
+
+static ps_replay_event_t events[PS_REPLAY_MAX_EVENTS];
+static int event_count;
+static uint32_t midi_bytes;
+
+// midi decoder state, running status is accepted
+static uint8_t running_status;
+static uint8_t data[2];
+static int data_count;
+// high resolution velocity prefix waiting for its note message
+static bool prefix;
+static uint8_t prefix_value;
+
+static void ps_replay_midi(uint8_t byte, uint32_t time_us)
+{
+    midi_bytes++;
+    if (byte & 0x80)
+    {
+        if (byte < 0xF0)
+        {
+            running_status = byte;
+            data_count = 0;
+        }
+        else if (byte < 0xF8)
+        {
+            running_status = 0; // system common cancels running status, real time does not
+        }
+        return;
+    }
+    if (!running_status)
+    {
+        return;
+    }
+    data[data_count++] = byte;
+    int needed = (running_status & 0xE0) == 0xC0 ? 1 : 2;
+    if (data_count < needed)
+    {
+        return;
+    }
+    data_count = 0;
+
+    uint8_t type = running_status & 0xF0;
+    if (type == 0xB0 && data[0] == MIDI_CC_HIGH_RES_VELOCITY_PREFIX)
+    {
+        prefix = true;
+        prefix_value = data[1];
+        return;
+    }
+    if ((type == 0x90 || type == 0x80) && event_count < PS_REPLAY_MAX_EVENTS)
+    {
+        ps_replay_event_t *event = &events[event_count++];
+        event->time = time_us;
+        event->note = data[0];
+        event->velocity = data[1];
+        event->on = type == 0x90 && data[1] != 0;
+        event->high_res = prefix;
+        event->fine_velocity = (data[1] << PS_VELOCITY_FINE_SHIFT) | prefix_value;
+    }
+    prefix = false;
+}
+
+static void ps_replay_begin(uint32_t start_time_us)
+{
+    ps_sim_init(start_time_us);
+    stroke_count = 0;
+    event_count = 0;
+    midi_bytes = 0;
+    running_status = 0;
+    data_count = 0;
+    prefix = false;
+    trace_end = start_time_us;
+    score_from = start_time_us;
+}
+
+static bool ps_replay_scored(uint32_t time_us)
+{
+    return (int32_t)(time_us - score_from) >= 0;
+}
+
+static void ps_replay_extend(uint32_t time_us)
+{
+    if ((int32_t)(time_us - trace_end) > 0)
+    {
+        trace_end = time_us;
+    }
+}
+
+static void ps_replay_stroke(int key, uint32_t press, uint32_t travel, uint32_t release, uint32_t release_travel)
+{
+    if (stroke_count == PS_REPLAY_MAX_STROKES || !ps_sim_key_stroke(key, press, travel, release, release_travel))
+    {
+        fprintf(stderr, "stroke on key %i at %" PRIu32 "us dropped\n", key, press);
+        return;
+    }
+    ps_replay_stroke_t *stroke = &strokes[stroke_count++];
+    memset(stroke, 0, sizeof(*stroke));
+    stroke->key = key;
+    stroke->press = press;
+    stroke->travel = travel;
+    stroke->release = release;
+    stroke->release_travel = release_travel;
+    ps_replay_extend(release + release_travel);
+}
+
+static void ps_replay_bounce(int key, int sw, uint32_t from, uint32_t to)
+{
+    if (!ps_host_add_closure(key, sw, from, to))
+    {
+        fprintf(stderr, "bounce on key %i at %" PRIu32 "us dropped\n", key, from);
+        return;
+    }
+    ps_replay_extend(to);
+}
+
+static uint32_t ps_replay_abs(int32_t value)
+{
+    return value < 0 ? -value : value;
+}
+
+// Difference in 7 bit velocity steps between a received velocity and the exact ones
+static double ps_replay_velocity_error(const ps_replay_event_t *event, uint8_t exact, uint16_t exact_fine)
+{
+    if (event->high_res)
+    {
+        return (double)ps_replay_abs((int32_t)event->fine_velocity - exact_fine) / PS_VELOCITY_FINE_ONE;
+    }
+    return ps_replay_abs((int32_t)event->velocity - exact);
+}
+
+static ps_replay_result_t ps_replay_run(void)
+{
+    ps_replay_result_t result;
+    memset(&result, 0, sizeof(result));
+    result.latency_min = INT32_MAX;
+    result.latency_max = INT32_MIN;
+
+    ps_sim_run_until(trace_end + PS_REPLAY_TAIL_US);
+    result.passes = ps_sim_passes();
+    result.scan_ns = ps_sim_scan_ns();
+    result.midi_bytes = midi_bytes;
+
+    for (int e = 0; e < event_count; e++)
+    {
+        ps_replay_event_t *event = &events[e];
+        ps_replay_stroke_t *match = NULL;
+        if (!ps_replay_scored(event->time))
+        {
+            continue;
+        }
+        for (int s = 0; s < stroke_count && !match; s++)
+        {
+            ps_replay_stroke_t *stroke = &strokes[s];
+            if (!ps_replay_scored(stroke->press) || (uint8_t)ps_map_key_to_note(stroke->key) != event->note)
+            {
+                continue;
+            }
+            uint32_t due = event->on ? stroke->press + stroke->travel : stroke->release + stroke->release_travel;
+            bool matched = event->on ? stroke->on_matched : stroke->off_matched;
+            if (!matched && ps_replay_abs((int32_t)(event->time - due)) < PS_REPLAY_MATCH_WINDOW_US)
+            {
+                match = stroke;
+            }
+        }
+
+        if (!event->on)
+        {
+            if (match)
+            {
+                match->off_matched = true;
+#if PS_MIDI_RELEASE_VELOCITY
+                double release_error = ps_replay_velocity_error(event, ps_velocity_release_exact(match->release_travel),
+                                                                ps_velocity_release_exact_fine(match->release_travel));
+                if (release_error > result.release_error_max) result.release_error_max = release_error;
+                result.release_error_sum += release_error;
+                result.offs++;
+#endif
+            }
+            else
+            {
+                result.ghost_offs++;
+            }
+            continue;
+        }
+        if (!match)
+        {
+            result.ghosts++;
+            continue;
+        }
+        match->on_matched = true;
+
+        int32_t latency = (int32_t)(event->time - (match->press + match->travel));
+        if (latency < result.latency_min) result.latency_min = latency;
+        if (latency > result.latency_max) result.latency_max = latency;
+        result.latency_sum += latency;
+        result.latencies++;
+
+        double velocity_error = ps_replay_velocity_error(event, ps_velocity_exact(match->key, match->travel),
+                                                         ps_velocity_exact_fine(match->key, match->travel));
+        if (velocity_error > result.velocity_error_max) result.velocity_error_max = velocity_error;
+        result.velocity_error_sum += velocity_error;
+    }
+
+    for (int s = 0; s < stroke_count; s++)
+    {
+        if (!ps_replay_scored(strokes[s].press))
+        {
+            continue;
+        }
+        result.notes++;
+        if (!strokes[s].on_matched) result.missed++;
+        if (!strokes[s].off_matched) result.missed_offs++;
+    }
+    return result;
+}
+
+static void ps_replay_print_header(void)
+{
+    printf("%-12s %6s %6s %6s %9s %9s %24s %14s %14s %6s %8s\n", "scenario", "notes", "missed", "ghost",
+           "lost offs", "ghost off", "latency min/mean/max us", "vel err mean/max", "off vel err", "bytes", "ns/pass");
+}
+
+static bool ps_replay_report(const char *name, const ps_replay_result_t *result)
+{
+    char latency[32] = "-";
+    char velocity[32] = "-";
+    char release[32] = "-";
+    if (result->latencies)
+    {
+        snprintf(latency, sizeof(latency), "%" PRIi32 "/%" PRIi64 "/%" PRIi32, result->latency_min,
+                 result->latency_sum / result->latencies, result->latency_max);
+        snprintf(velocity, sizeof(velocity), "%.2f/%.2f",
+                 result->velocity_error_sum / result->latencies, result->velocity_error_max);
+    }
+    if (result->offs)
+    {
+        snprintf(release, sizeof(release), "%.2f/%.2f",
+                 result->release_error_sum / result->offs, result->release_error_max);
+    }
+    printf("%-12s %6" PRIu32 " %6" PRIu32 " %6" PRIu32 " %9" PRIu32 " %9" PRIu32 " %24s %14s %14s %6" PRIu32 " %8" PRIu64 "\n",
+           name, result->notes, result->missed, result->ghosts, result->missed_offs, result->ghost_offs,
+           latency, velocity, release, result->midi_bytes, result->passes ? result->scan_ns / result->passes : 0);
+    return result->missed == 0 && result->ghosts == 0 && result->missed_offs == 0 && result->ghost_offs == 0;
+}
+
+#define PS_REPLAY_KEYS PS_NUMBER_OF_KEYS
+
+static void ps_replay_glissando_strokes(uint32_t t)
+{
+    for (int i = 0; i < PS_REPLAY_KEYS * 2 - 1; i++)
+    {
+        int key = i < PS_REPLAY_KEYS ? i : PS_REPLAY_KEYS * 2 - 2 - i;
+        ps_replay_stroke(key, t, 4000 + (i % 7) * 500, t + 18000, 2000);
+        t += 12000;
+    }
+}
+
+// Up and back down the whole keyboard, each key overlapping the next
+static void ps_replay_glissando(uint32_t start)
+{
+    ps_replay_begin(start);
+    ps_replay_glissando_strokes(start + 10000);
+}
+
+// One key struck as fast as the action repeats, getting louder
+static void ps_replay_repeated(void)
+{
+    ps_replay_begin(0);
+    uint32_t t = 10000;
+    for (int i = 0; i < 30; i++)
+    {
+        ps_replay_stroke(40, t, 30000 - i * 900, t + 35000, 2000);
+        t += 70000;
+    }
+}
+
+// Ten finger chords, the fingers landing within a millisecond of each other
+static void ps_replay_chords(void)
+{
+    static const int chord[10] = { 5, 9, 12, 17, 21, 36, 40, 43, 48, 52 };
+    ps_replay_begin(0);
+    uint32_t t = 10000;
+    for (int c = 0; c < 8; c++)
+    {
+        for (int f = 0; f < 10; f++)
+        {
+            uint32_t press = t + ((f * 7 + c * 3) % 10) * 100;
+            ps_replay_stroke(chord[f] + c, press, 3000 + f * 1500 + c * 2000, t + 200000 + f * 500, 2500);
+        }
+        t += 300000;
+    }
+}
+
+// Ten fingers let go of one chord just as they strike the next, so ten
+// releases are queued with the note-ons
+static void ps_replay_chord_swap(void)
+{
+    static const int chord[2][10] =
+    {
+        { 5, 9, 12, 17, 21, 36, 40, 43, 48, 52 },
+        { 7, 10, 14, 19, 22, 38, 41, 45, 50, 53 },
+    };
+    ps_replay_begin(0);
+    uint32_t t = 10000;
+    for (int c = 0; c < 8; c++)
+    {
+        for (int f = 0; f < 10; f++)
+        {
+            // the make contact of the old chord opens as the new chord's break contact closes
+            ps_replay_stroke(chord[c & 1][f], t + f * 50, 4000, t + 150000, 4000 + f * 50);
+        }
+        t += 154000;
+    }
+}
+
+// Fortissimo staccato: the key is thrown down and bounces straight back, so
+// the break contact is only closed for a fraction of a scan pass
+static void ps_replay_staccato(void)
+{
+    ps_replay_begin(0);
+    uint32_t t = 10000;
+    for (int i = 0; i < 40; i++)
+    {
+        uint32_t closed = 50 + (i % 8) * 37;
+        ps_replay_stroke((i * 7) % PS_REPLAY_KEYS, t, 3000, t + 3000 + closed, 1500);
+        t += 25013; // not in step with the scan
+    }
+}
+
+// Contacts that chatter as they close and open
+static void ps_replay_bouncing(void)
+{
+    ps_replay_begin(0);
+    uint32_t t = 10000;
+    for (int i = 0; i < 20; i++)
+    {
+        int key = (i * 13) % PS_REPLAY_KEYS;
+        uint32_t travel = 6000 + i * 1000;
+        uint32_t release = t + 80000;
+        // make chatters before closing, break closes once then chatters
+        ps_replay_bounce(key, 0, t - 700, t - 550);
+        ps_replay_bounce(key, 0, t - 300, t - 200);
+        ps_replay_bounce(key, 1, t + travel - 350, t + travel - 250);
+        ps_replay_stroke(key, t, travel, release, 2000);
+        // make chatters after opening
+        ps_replay_bounce(key, 0, release + 2000 + 300, release + 2000 + 450);
+        t += 120000;
+    }
+}
+
+// The event task is starved while every key is struck over and over, far more
+// events than the key event queue holds. Those notes come out late or not at
+// all and are not scored; the glissando after it must come out whole, every
+// note-on still followed by its note-off.
+static void ps_replay_event_stall(void)
+{
+    ps_replay_begin(0);
+    uint32_t t = 10000;
+    for (int c = 0; c < 6; c++)
+    {
+        for (int key = 0; key < PS_REPLAY_KEYS; key++)
+        {
+            ps_replay_stroke(key, t + key * 20, 3000 + (key % 5) * 700, t + 40000, 2000 + (key % 3) * 500);
+        }
+        t += 60000;
+    }
+    ps_sim_stall_events(0, t);
+    score_from = t + 200000;
+    ps_replay_glissando_strokes(score_from);
+}
+
+static bool ps_replay_file(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    ps_replay_begin(0);
+    char line[256];
+    int line_number = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), f))
+    {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = 0;
+
+        int key, sw;
+        uint32_t a, b, c, d;
+        if (sscanf(line, " bounce %i %i %" SCNu32 " %" SCNu32, &key, &sw, &a, &b) == 4)
+        {
+            ps_replay_bounce(key, sw, a, b);
+        }
+        else if (sscanf(line, " %i %" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32, &key, &a, &b, &c, &d) == 5)
+        {
+            ps_replay_stroke(key, a, b, c, d);
+        }
+        else if (strspn(line, " \t\r\n") != strlen(line))
+        {
+            fprintf(stderr, "%s:%i: cannot parse line\n", path, line_number);
+            ok = false;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+// Largest difference between the table lookup and the exact curve of each
+// profile, in 7 bit velocities and in fine (14 bit) steps
+static void ps_replay_velocity_tables(void)
+{
+    for (int p = 0; p < ps_velocity_profile_count(); p++)
+    {
+        ps_velocity_select(p);
+        uint32_t error_max = 0;
+        uint32_t fine_error_max = 0;
+        for (uint32_t time_us = 0; time_us < PS_MAX_KEY_TIME_US + 20000; time_us += 10)
+        {
+            uint32_t error = ps_replay_abs((int32_t)ps_velocity_map(0, time_us) - ps_velocity_exact(0, time_us));
+            if (error > error_max) error_max = error;
+            error = ps_replay_abs((int32_t)ps_velocity_map_fine(0, time_us) - ps_velocity_exact_fine(0, time_us));
+            if (error > fine_error_max) fine_error_max = error;
+        }
+        printf("velocity table %-14s max error vs curve:%" PRIu32 " fine:%" PRIu32 "/%u\n", ps_velocity_profile(p)->name,
+               error_max, fine_error_max, PS_VELOCITY_FINE_ONE);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+    ps_velocity_init();
+    ps_replay_velocity_tables();
+    ps_host_set_midi_handler(ps_replay_midi);
+    ps_replay_print_header();
+
+    ps_replay_result_t result;
+    ps_replay_glissando(0);
+    result = ps_replay_run();
+    ok &= ps_replay_report("glissando", &result);
+
+    ps_replay_repeated();
+    result = ps_replay_run();
+    ok &= ps_replay_report("repeated", &result);
+
+    ps_replay_chords();
+    result = ps_replay_run();
+    ok &= ps_replay_report("chords", &result);
+
+    ps_replay_chord_swap();
+    result = ps_replay_run();
+    ok &= ps_replay_report("chord swap", &result);
+
+    ps_replay_bouncing();
+    result = ps_replay_run();
+    ok &= ps_replay_report("bouncing", &result);
+
+    ps_replay_event_stall();
+    result = ps_replay_run();
+    ok &= ps_replay_report("event stall", &result);
+
+    // a switch is only seen while its half bank is energised, so some of these
+    // are missed whatever the scan mode: reported, not failed
+    ps_replay_staccato();
+    result = ps_replay_run();
+    ps_replay_report("staccato", &result);
+
+    // the same glissando across the 32 bit timer wrap
+    ps_replay_glissando(UINT32_MAX - 1000000);
+    result = ps_replay_run();
+    ok &= ps_replay_report("timer wrap", &result);
+
+    // with high resolution velocity prefixes
+    ps_set_high_res_velocity(true);
+    ps_replay_glissando(0);
+    result = ps_replay_run();
+    ok &= ps_replay_report("glissando hr", &result);
+
+    ps_replay_chords();
+    result = ps_replay_run();
+    ok &= ps_replay_report("chords hr", &result);
+    ps_set_high_res_velocity(false);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!ps_replay_file(argv[i]))
+        {
+            ok = false;
+            continue;
+        }
+        result = ps_replay_run();
+        ok &= ps_replay_report(argv[i], &result);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ps_ring.h"
+
+// Two thread stress test of the single producer / single consumer ring. The
+// producer pushes variable length records, each a header with a sequence
+// number and length followed by a payload made from the sequence number, into a
+// small ring so that nearly every push and pop races the other thread and
+// records wrap at the end of the storage. The consumer checks that every record
+// arrives once, in order and whole. Both threads yield while they wait, so
+// the test still runs on a single core, where the threads then only meet
+// when one is preempted part way through a push or pop.
+//
+//   ps_ring_stress            pushes PS_RING_STRESS_RECORDS records
+//   ps_ring_stress <records>
+//
+// The exit status is 1 if a record was lost, reordered or torn.
+
+#define PS_RING_STRESS_RECORDS 5000000u
+// Records are 8 to 65 bytes and most lengths do not divide the ring, so the
+// wrap point keeps moving
+#define PS_RING_STRESS_RING_BYTES 256
+#define PS_RING_STRESS_MAX_PAYLOAD 57
+
+typedef struct
+{
+    uint32_t sequence;
+    uint16_t length;     // payload bytes
+    uint16_t check;      // ~length, catches a header read from the wrong place
+} ps_ring_stress_header_t;
+
+static uint8_t storage[PS_RING_STRESS_RING_BYTES];
+static ps_ring_t ring;
+static uint32_t records = PS_RING_STRESS_RECORDS;
+
+static uint16_t ps_ring_stress_length(uint32_t sequence)
+{
+    return (sequence * 2654435761u >> 16) % (PS_RING_STRESS_MAX_PAYLOAD + 1);
+}
+
+static uint8_t ps_ring_stress_byte(uint32_t sequence, uint32_t i)
+{
+    return (uint8_t)(sequence * 31 + i * 7 + (sequence >> 8));
+}
+
+static void *ps_ring_stress_producer(void *arg)
+{
+    uint8_t record[sizeof(ps_ring_stress_header_t) + PS_RING_STRESS_MAX_PAYLOAD];
+    for (uint32_t sequence = 0; sequence < records; sequence++)
+    {
+        ps_ring_stress_header_t header;
+        header.sequence = sequence;
+        header.length = ps_ring_stress_length(sequence);
+        header.check = (uint16_t)~header.length;
+        memcpy(record, &header, sizeof(header));
+        for (uint32_t i = 0; i < header.length; i++)
+        {
+            record[sizeof(header) + i] = ps_ring_stress_byte(sequence, i);
+        }
+        while (!ps_ring_push(&ring, record, sizeof(header) + header.length))
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        records = strtoul(argv[1], NULL, 0);
+    }
+    ps_ring_init(&ring, storage, sizeof(storage));
+
+    pthread_t producer;
+    if (pthread_create(&producer, NULL, ps_ring_stress_producer, NULL) != 0)
+    {
+        printf("Could not start the producer\n");
+        return 1;
+    }
+
+    uint32_t errors = 0;
+    uint64_t bytes = 0;
+    uint8_t record[sizeof(ps_ring_stress_header_t) + PS_RING_STRESS_MAX_PAYLOAD];
+    for (uint32_t expected = 0; expected < records && errors < 10; expected++)
+    {
+        // the header says how much to pop; the record is pushed whole, so
+        // once its header is there all of it is
+        ps_ring_stress_header_t header;
+        while (!ps_ring_peek(&ring, &header, sizeof(header)))
+        {
+            sched_yield();
+        }
+        if (header.sequence != expected || header.check != (uint16_t)~header.length
+            || header.length > PS_RING_STRESS_MAX_PAYLOAD)
+        {
+            printf("Record %" PRIu32 ": bad header, sequence %" PRIu32 " length %u check %04x\n",
+                   expected, header.sequence, header.length, header.check);
+            errors++;
+            break;
+        }
+        if (!ps_ring_pop(&ring, record, sizeof(header) + header.length))
+        {
+            printf("Record %" PRIu32 ": header without its payload\n", expected);
+            errors++;
+            break;
+        }
+        for (uint32_t i = 0; i < header.length; i++)
+        {
+            if (record[sizeof(header) + i] != ps_ring_stress_byte(expected, i))
+            {
+                printf("Record %" PRIu32 ": payload byte %" PRIu32 " torn\n", expected, i);
+                errors++;
+                break;
+            }
+        }
+        bytes += sizeof(header) + header.length;
+    }
+    if (errors)
+    {
+        // the producer may be stuck on a full ring, do not wait for it
+        printf("FAILED\n");
+        return 1;
+    }
+    pthread_join(producer, NULL);
+    if (ps_ring_used(&ring) != 0)
+    {
+        printf("%" PRIu32 " bytes left in the ring\n", ps_ring_used(&ring));
+        return 1;
+    }
+    printf("%" PRIu32 " records, %" PRIu64 " bytes through a %u byte ring: ok\n",
+           records, bytes, PS_RING_STRESS_RING_BYTES);
+    return 0;
+}
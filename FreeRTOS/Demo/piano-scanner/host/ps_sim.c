@@ -0,0 +1,95 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "piano_scanner.h"
+#include "ps_scan.h"
+#include "ps_pins.h"
+#include "ps_stats.h"
+#include "ps_output.h"
+#include "ps_events.h"
+#include "ps_log.h"
+#include "ps_velocity.h"
+#include "host/ps_sim.h"
+
+static uint64_t scan_ns;
+static uint32_t passes;
+static uint32_t stall_from;
+static uint32_t stall_to;
+
+static uint64_t ps_sim_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void ps_sim_init(uint32_t start_time_us)
+{
+    scan_ns = 0;
+    passes = 0;
+    stall_from = stall_to = start_time_us;
+    ps_host_reset(start_time_us);
+    ps_pins_init();
+    ps_output_init();
+    ps_log_init();
+    ps_init_key_events();
+    ps_reset_key_states();
+    ps_velocity_init();
+    ps_stats_reset();
+    ps_scan_reset();
+}
+
+bool ps_sim_key_stroke(int key, uint32_t press_us, uint32_t travel_us, uint32_t release_us, uint32_t release_travel_us)
+{
+    return ps_host_add_closure(key, 0, press_us, release_us + release_travel_us)
+        && ps_host_add_closure(key, 1, press_us + travel_us, release_us);
+}
+
+void ps_sim_stall_events(uint32_t from_us, uint32_t to_us)
+{
+    stall_from = from_us;
+    stall_to = to_us;
+}
+
+uint32_t ps_sim_time_us(void)
+{
+    return ps_host_time_us();
+}
+
+void ps_sim_run_until(uint32_t end_us)
+{
+    while ((int32_t)(end_us - ps_host_time_us()) > 0)
+    {
+        ps_host_advance_us(PS_SCAN_HALF_BANK_PERIOD_US);
+        uint64_t start_ns = ps_sim_ns();
+        bool ready = ps_scan_tick();
+        if (ready)
+        {
+            const ps_scan_frame_t *frame = ps_scan_ready_frame();
+            uint32_t process_start_time = READ_U32BIT_US_TIME();
+            ps_process_frame(frame);
+            ps_stats_frame(frame->time[0], process_start_time, READ_U32BIT_US_TIME());
+            ps_scan_release_frame();
+            passes++;
+        }
+        scan_ns += ps_sim_ns() - start_ns;
+        // the event task, which runs once the producer task blocks again, then
+        // the log flush below it
+        if (ps_host_time_us() - stall_from >= stall_to - stall_from)
+        {
+            ps_events_dispatch();
+        }
+        ps_log_flush();
+    }
+}
+
+uint32_t ps_sim_passes(void)
+{
+    return passes;
+}
+
+uint64_t ps_sim_scan_ns(void)
+{
+    return scan_ns;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "host/ps_hal_host.h"
+
+// Runs the real scan engine, key state machine and midi output against the
+// hardware models in ps_hal_host.c. The scan timer interrupt is replaced by a
+// loop that moves the clock on PS_SCAN_HALF_BANK_PERIOD_US at a time; frames are
+// processed as soon as they complete.
+
+// Resets the models, the scanner and the statistics. The clock starts at
+// start_time_us so runs can be started just before the 32 bit timer wraps.
+void ps_sim_init(uint32_t start_time_us);
+
+// Queues one key stroke. The make contact closes at press_us and the break
+// contact travel_us later. The break contact opens at release_us and the make
+// contact release_travel_us after that.
+bool ps_sim_key_stroke(int key, uint32_t press_us, uint32_t travel_us, uint32_t release_us, uint32_t release_travel_us);
+
+// Keeps the event task from running while the clock is from from_us up to
+// to_us, as if it were starved, so the key event queue fills up.
+// ps_sim_init() cancels it.
+void ps_sim_stall_events(uint32_t from_us, uint32_t to_us);
+
+// Runs the scanner until the clock reaches end_us
+void ps_sim_run_until(uint32_t end_us);
+
+uint32_t ps_sim_time_us(void);
+
+// Complete scan passes processed since ps_sim_init()
+uint32_t ps_sim_passes(void);
+
+// Host time spent in the scan tick and frame processing since ps_sim_init().
+// This includes the cost of the hardware models behind the hal macros but not
+// the key event handlers (midi encoding), which run after each tick as the
+// event task would.
+uint64_t ps_sim_scan_ns(void);
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "piano_scanner.h"
+#include "ps_stats.h"
+#include "ps_output.h"
+#include "host/ps_sim.h"
+
+// Plays a few strokes through the simulator and prints the midi that comes
+// out of the uart model, followed by the scan statistics.
+
+// note messages only, with running status
+static uint8_t status;
+static uint8_t data[2];
+static int data_count;
+
+static void print_midi(uint8_t byte, uint32_t time_us)
+{
+    if (byte & 0x80)
+    {
+        status = byte;
+        data_count = 0;
+        return;
+    }
+    data[data_count++] = byte;
+    if (data_count < 2)
+    {
+        return;
+    }
+    data_count = 0;
+    if ((status & 0xE0) != 0x80)
+    {
+        return; // not a note message
+    }
+    bool on = (status & 0xF0) == 0x90 && data[1] != 0;
+    printf("%10" PRIu32 "us  %s note:%u velocity:%u\n", time_us, on ? "on " : "off", data[0], data[1]);
+}
+
+int main(void)
+{
+    ps_host_set_midi_handler(print_midi);
+    ps_sim_init(0);
+
+    // a slow scale followed by a loud chord
+    uint32_t t = 10000;
+    for (int key = 0; key < 8; key++)
+    {
+        ps_sim_key_stroke(key * 2, t, 60000 - key * 7000, t + 100000, 3000);
+        t += 50000;
+    }
+    for (int key = 40; key < 50; key += 2)
+    {
+        ps_sim_key_stroke(key, t, 3000, t + 200000, 2000);
+    }
+    ps_sim_run_until(t + 300000);
+
+    ps_stats_dump();
+    ps_output_dump();
+    return 0;
+}
@@ -8,17 +8,39 @@
 #include "bcm2835_irq.h"
 #include "bcm2835_systimer.h"
 #include "bcm2835_miniuart.h"
+#include "bcm2835_pl011.h"
+#include "libc_functions.h"
 #include "raspberrypi1.h"
 
 #include "piano_scanner.h"
 
 
 
+#if PS_MIDI_UART_PL011
+/* stdio on UART0 until the command task takes it over */
+static int pl011_write(int fd, const void *buf, size_t count) {
+	bcm2835_pl011_send_blocking(buf, count);
+	return count;
+}
+
+static int pl011_read(int fd, void *buf, size_t count) {
+	bcm2835_pl011_receive_blocking(buf, count);
+	return count;
+}
+#endif
+
 int main (void) {
 	/* Initialize the bcm2835 lib */
 	bcm2835_init();
+#if PS_MIDI_UART_PL011
+	bcm2835_pl011_open(PS_MIDI_UART_BAUD, PS_MIDI_UART_PL011_CLOCK_HZ);
+	bcm2835_pl011_set_fifo(PS_MIDI_UART_PL011_TX_LEVEL, PS_MIDI_UART_PL011_TX_BATCH, PS_MIDI_UART_PL011_RX_LEVEL);
+	libc_set_write_handler(pl011_write);
+	libc_set_read_handler(pl011_read);
+#else
 	/* Initialize the miniuart (Otherwise printf doesn't work) */
 	bcm2835_miniuart_open();
+#endif
 
 	bcm2835_gpio_fsel(LED_PIN, BCM2835_GPIO_FSEL_OUTP);
 
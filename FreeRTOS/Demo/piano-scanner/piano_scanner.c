@@ -1,131 +1,173 @@
-#include <FreeRTOS.h>
-#include <task.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
 #include "piano_scanner.h"
-#include "drivers/bcm2835.h"
-#include "bcm2835_miniuart.h"
-
-#define PS_KEY_STATE_IDLE 0
-#define PS_KEY_STATE_STARTED 1
-#define PS_KEY_STATE_HIT 2
-
+#include "ps_output.h"
+#include "ps_events.h"
+#include "ps_scan.h"
+#include "ps_stats.h"
+#include "ps_velocity.h"
+#include "ps_calibration.h"
+
+// Key state is kept per bank in separate arrays rather than per key, so a scan
+// pass reads the 3 word state of each bank (with 8 key banks all of them fit in
+// one cache line) and only touches a bank's key times when one of its keys is
+// moving.
+
+// Three bit planes, at most one bit set per key, give each key its state:
+// STARTED, HIT, RELEASING or, with no bit set, IDLE
 typedef struct
 {
-    uint32_t press_time;
-    uint32_t state;
-} key_data_t;
+    ps_bank_bits_t started;
+    ps_bank_bits_t hit;
+    ps_bank_bits_t releasing;
+} ps_bank_state_t;
 
-key_data_t key_data[PS_NUMBER_OF_KEY_BANKS * PS_NUMBER_OF_KEYS_PER_BANK];
+static ps_bank_state_t bank_state[PS_NUMBER_OF_KEY_BANKS];
+// When the make switch closed (STARTED) or the break switch opened (RELEASING)
+static uint32_t press_time[PS_NUMBER_OF_KEY_BANKS][PS_NUMBER_OF_KEYS_PER_BANK];
 
-static char midi_out_buffer[PS_MIDI_OUT_BUFFER_SIZE_BYTES];
-static int midi_out_buffer_in_index;
-static int midi_out_buffer_out_index;
-// Empty condition midi_out_buffer_in_index == midi_out_buffer_out_index
-#define MIDI_OUT_BUFFER_EMPTY (midi_out_buffer_out_index == midi_out_buffer_in_index)
-#define MIDI_OUT_BUFFER_FULL (midi_out_buffer_out_index == 0 ? midi_out_buffer_in_index == PS_MIDI_OUT_BUFFER_SIZE_BYTES - 1 : midi_out_buffer_in_index == midi_out_buffer_out_index - 1)
-// Full condition midi_out_buffer_out_index == midi_out_buffer_in_index + 1  (modulo PS_MIDI_OUT_BUFFER_SIZE_BYTES)
-#define MIDI_OUT_BUFFER_INDEX_INCREMENT(index) (index = (index < PS_MIDI_OUT_BUFFER_SIZE_BYTES - 1 ? index + 1 : 0))
+static volatile bool high_res_velocity = PS_MIDI_HIGH_RES_VELOCITY;
 
-void ps_producer_task(void *params);
+char ps_map_key_to_note(int key)
+{
+    return (char) (key + PS_MIDI_NOTE_KEY0_OFFSET);
+}
 
-// The consumer task is this function - run cooperatively
-void ps_consume_char_from_buffer_if_possible()
+// Queues a whole midi message for the uart. Never blocks the scanner: if there
+// is no room the message is dropped rather than sending a partial message.
+void ps_send_message_to_buffer(ps_output_class_t output_class, char status, char data1, char data2)
 {
-    if (MIDI_OUT_BUFFER_EMPTY) return;
-    if(UART_TX_READY())
+    uint8_t message[3] = { status, data1, data2 };
+    ps_output_send(output_class, message, sizeof(message));
+}
+
+// Queues a note message with a high resolution velocity prefix in one record, so
+// nothing can come between the two
+static void ps_send_high_res_note(ps_output_class_t output_class, char status, int key, uint16_t fine_velocity)
+{
+    uint8_t message[6] =
     {
-        UART_TX_CHAR(midi_out_buffer[midi_out_buffer_out_index]); // block if no fifo space available
-        MIDI_OUT_BUFFER_INDEX_INCREMENT(midi_out_buffer_out_index);
-    }
+        MIDI_STATUS_CONTROL_CHANGE(PS_MIDI_CHANNEL), MIDI_CC_HIGH_RES_VELOCITY_PREFIX, fine_velocity & 0x7F,
+        status, ps_map_key_to_note(key), fine_velocity >> PS_VELOCITY_FINE_SHIFT
+    };
+    ps_output_send(output_class, message, sizeof(message));
 }
 
-char ps_map_key_to_note(int key)
+void ps_set_high_res_velocity(bool on)
 {
-    return (char) (key + PS_MIDI_NOTE_KEY0_OFFSET);
+    high_res_velocity = on;
+}
+
+bool ps_high_res_velocity(void)
+{
+    return high_res_velocity;
 }
 
-char ps_map_time_to_velocity(uint32_t key_time_us)
+void ps_reset_key_states(void)
 {
-    float velocity = (key_time_us * PS_VELOCITY_MAPPING_SLOPE + PS_VELOCITY_MAPPING_OFFSET);
-    PS_SATURATE(MIDI_MAX_VELOCITY, MIDI_MIN_VELOCITY, velocity);
-    return (char)(velocity + 0.5);
+    memset(bank_state, 0, sizeof(bank_state));
+    memset(press_time, 0, sizeof(press_time));
 }
 
-void ps_send_char_to_buffer_blocking_if_full(char data)
+void ps_send_note_on(int key, uint32_t key_time_us)
 {
-    if(MIDI_OUT_BUFFER_FULL)
+    if (high_res_velocity)
     {
-        ps_consume_char_from_buffer_if_possible();
+        ps_send_high_res_note(PS_OUTPUT_NOTE_ON, MIDI_STATUS_NOTE_ON(PS_MIDI_CHANNEL), key, ps_velocity_map_fine(key, key_time_us));
+        return;
     }
-    midi_out_buffer[midi_out_buffer_in_index] = data;
-    MIDI_OUT_BUFFER_INDEX_INCREMENT(midi_out_buffer_in_index);
+    ps_send_message_to_buffer(PS_OUTPUT_NOTE_ON, MIDI_STATUS_NOTE_ON(PS_MIDI_CHANNEL), ps_map_key_to_note(key), ps_velocity_map(key, key_time_us));
 }
 
-void ps_send_note_on(int key, uint32_t key_time_us)
+void ps_send_note_off(int key, uint32_t release_time_us)
 {
-    ps_send_char_to_buffer_blocking_if_full(MIDI_STATUS_NOTE_ON(PS_MIDI_CHANNEL));
-    ps_send_char_to_buffer_blocking_if_full(ps_map_key_to_note(key));
-    ps_send_char_to_buffer_blocking_if_full(ps_map_time_to_velocity(key_time_us));
+#if PS_MIDI_RELEASE_VELOCITY
+    if (high_res_velocity)
+    {
+        ps_send_high_res_note(PS_OUTPUT_NOTE_OFF, MIDI_STATUS_NOTE_OFF(PS_MIDI_CHANNEL), key, ps_velocity_map_release_fine(release_time_us));
+        return;
+    }
+    ps_send_message_to_buffer(PS_OUTPUT_NOTE_OFF, MIDI_STATUS_NOTE_OFF(PS_MIDI_CHANNEL), ps_map_key_to_note(key), ps_velocity_map_release(release_time_us));
+#elif PS_MIDI_RUNNING_STATUS
+    ps_send_message_to_buffer(PS_OUTPUT_NOTE_OFF, MIDI_STATUS_NOTE_ON(PS_MIDI_CHANNEL), ps_map_key_to_note(key), 0);
+#else
+    ps_send_message_to_buffer(PS_OUTPUT_NOTE_OFF, MIDI_STATUS_NOTE_OFF(PS_MIDI_CHANNEL), ps_map_key_to_note(key), 0);
+#endif
 }
 
-void ps_send_note_off(int key)
+// Key event handlers, run by the dispatching task (see ps_events.h)
+
+static void ps_midi_key_event(const ps_key_event_t *event)
 {
-    ps_send_char_to_buffer_blocking_if_full(MIDI_STATUS_NOTE_OFF(PS_MIDI_CHANNEL));
-    ps_send_char_to_buffer_blocking_if_full(ps_map_key_to_note(key));
-    ps_send_char_to_buffer_blocking_if_full(0); // Not sending note off velocity for now.
+    if (event->edge == PS_KEY_STRIKE)
+    {
+        ps_send_note_on(event->key, event->duration);
+    }
+    else if (event->edge == PS_KEY_RELEASE)
+    {
+        ps_send_note_off(event->key, event->duration);
+    }
 }
 
-void ps_init(void)
+static void ps_record_key_event(const ps_key_event_t *event)
 {
-    PS_LOG_FMT("Init Piano Scanner %i", 4);
-	printf("Slope : %f\n\r", PS_VELOCITY_MAPPING_SLOPE);
-	printf("Offset : %f\n\r", PS_VELOCITY_MAPPING_OFFSET);
-	printf("Slope : %i\n\r", (int)PS_VELOCITY_MAPPING_SLOPE);
-	printf("Offset : %i\n\r", (int)PS_VELOCITY_MAPPING_OFFSET);
-	printf("80000 : %i\n\r", ps_map_time_to_velocity(80000));
-	printf("90000 : %i\n\r", ps_map_time_to_velocity(90000));
-	printf("2900 : %i\n\r", ps_map_time_to_velocity(2900));
-	printf("1000 : %i\n\r", ps_map_time_to_velocity(1000));
-
-    // set up gpio
-    bcm2835_gpio_fsel(PS_SHIFT_REG_RESET_GPIO_NUMBER, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(PS_SHIFT_REG_INPUT_GPIO_NUMBER, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(PS_SHIFT_REG_CLOCK_GPIO_NUMBER, BCM2835_GPIO_FSEL_OUTP);
-    bcm2835_gpio_fsel(PS_SHIFT_REG_LATCH_GPIO_NUMBER, BCM2835_GPIO_FSEL_OUTP);
-
-    bcm2835_gpio_clr(PS_SHIFT_REG_RESET_GPIO_NUMBER);
-    bcm2835_gpio_clr(PS_SHIFT_REG_INPUT_GPIO_NUMBER);
-    bcm2835_gpio_clr(PS_SHIFT_REG_CLOCK_GPIO_NUMBER);
-    bcm2835_gpio_clr(PS_SHIFT_REG_LATCH_GPIO_NUMBER);
-
-    for (size_t pin = PS_KEY_0_PORT_GPIO_NUMBER; pin <= PS_KEY_7_PORT_GPIO_NUMBER; pin++)
+    if (event->edge == PS_KEY_STRIKE)
     {
-        bcm2835_gpio_fsel(pin, BCM2835_GPIO_FSEL_INPT);
-        bcm2835_gpio_set_pud(pin, BCM2835_GPIO_PUD_DOWN);
+        ps_stats_key_hit(event->key, event->duration);
+        ps_calibration_key_hit(event->key, event->duration);
     }
+}
 
-    // run consumer task
+#if PS_DEBUG_LOGGING
+static void ps_log_key_event(const ps_key_event_t *event)
+{
+    static const char *const edge_names[] = { "START", "HIT", "IDLE", "NO HIT", "ERROR end detected before start" };
+    int bank = event->key / PS_NUMBER_OF_KEYS_PER_BANK;
+    int bit = event->key % PS_NUMBER_OF_KEYS_PER_BANK;
+    if (event->edge == PS_KEY_STRIKE || event->edge == PS_KEY_RELEASE)
+    {
+        PS_LOG_FMT("%s: key:%i bank:%i, bit:%i, duration:%" PRIu32, edge_names[event->edge], event->key, bank, bit, event->duration);
+    }
+    else
+    {
+        PS_LOG_FMT("%s: key:%i bank:%i, bit:%i", edge_names[event->edge], event->key, bank, bit);
+    }
+}
+#endif
 
-    // run producer task 
-    BaseType_t ret = xTaskCreate(ps_producer_task, "key_producer", 512, NULL, 2, NULL);
-    PS_LOG_FMT("Created key producer task %li", ret);
+void ps_init_key_events(void)
+{
+    ps_events_init();
+    ps_events_add_handler(ps_record_key_event);
+    ps_events_add_handler(ps_midi_key_event);
+#if PS_DEBUG_LOGGING
+    ps_events_add_handler(ps_log_key_event);
+#endif
 }
 
-// This task scans the keyboard by clocking a shift
-// register to walk a bit past all the make/break (m/b) (aka start/finish or switch1/2)
-// switches. On the Roland EP 50 they are all normally low switches with inline diodes
+// The keyboard is scanned by clocking a shift register to walk a bit past
+// all the make/break (m/b) (aka start/finish or switch1/2) switches.
+// On the Roland EP 50 they are all normally low switches with inline diodes
 // back to the m/b lines. Either an m or b line for one bank at a time is energised
-// and then the 8 keys in the bank can be read on the gpio inputs
+// and then the 8 keys in the bank can be read on the gpio inputs.
 //
-// Each scan loop, the consumer task is cooperatively run
-// This is simply attempting to send a char to the uart if available
+// The shift register is clocked and the inputs sampled from the scan timer
+// interrupt (see ps_scan.c). The producer task (ps_tasks.c) waits for each
+// complete frame and runs the key state machine below over it.
+//
+// The state machine only queues a key event for each transition (see
+// ps_events.h). A lower priority task turns them into midi messages, which are
+// queued by priority in ps_output.c and sent by the uart tx interrupt, so the
+// scan loop never waits on velocity mapping, formatting or the uart.
 //
 // The following state machine is implemented
 //
 //                  Start button down          End button down
-//                   /record start time         /calc velocity
-//                                              /queue hit
+//                   /record start time         /queue strike
+//                                              /with duration
 //       ┌─────────────────────────────┐ ┌───────────────────────┐
 //       │                             │ │                       │
 //       │                             │ │                       │
@@ -135,160 +177,146 @@ void ps_init(void)
 //  │   IDLE   ◄──────────────────┤  START   │               │   DOWN   │
 //  │          │                  │          │               │          │
 //  │          │                  │          │               │          │
-//  └────▲─────┘                  └──────────┘               └───┬──────┘
-//       │                                                       │
-//       │                   Start button up                     │
-//       └───────────────────────────────────────────────────────┘
+//  └────▲─────┘                  └──────────┘               └──┬────▲──┘
+//       │                                      End button up   │    │ End button
+//       │   Start button up                    /record         │    │ down
+//       │   /queue release with duration       release time  ┌─▼────┴─────┐
+//       └────────────────────────────────────────────────────┤ RELEASING  │
+//                                                            └────────────┘
+//
+// DOWN also goes straight to IDLE, with a release too fast to time, when both
+// buttons open within one pass.
+//
+// A transition only happens once its event is queued. When the event queue is
+// full the key stays where it was and takes the transition again next pass, so
+// every strike that reaches the midi output is followed by its release.
 
-void ps_producer_task(void *params)
+//
+// The states are held as bitmasks per bank, so each transition is worked out
+// for the whole bank at once from the switch bits and only the keys that take
+// it are visited. A bank with nothing happening costs a few logic operations.
+
+// Visits each set bit of a bank mask, highest first
+#define PS_FOR_EACH_KEY_IN(mask, position) \
+    for (uint32_t pending_ = (mask), position; \
+         pending_ && (position = 31 - __builtin_clz(pending_), pending_ &= ~(1UL << position), true); )
+
+// Queues a key's event, leaving its bit set in retry if the queue is full
+#define PS_PUSH_OR_RETRY(retry, bank, position, edge, time, duration) \
+    do { \
+        if (!ps_events_push((bank) * PS_NUMBER_OF_KEYS_PER_BANK + (position), edge, time, duration)) \
+        { \
+            retry |= 1UL << (position); \
+        } \
+    } while (0)
+
+void ps_process_frame(const ps_scan_frame_t *frame)
 {
-    uint32_t loops = 0;
-    // uint32_t start_time;
-    bool led_on = false;
-    PS_LOG_FMT("Starting! %i", 1);
-    for (;;)
+    for (int bank = 0; bank < PS_NUMBER_OF_KEY_BANKS; bank++)
     {
-        // Consumer task is implemented here cooperatively
-        // TODO - If we only have one task why are we using an rtos!??
-        ps_consume_char_from_buffer_if_possible();
-
-        // bcm2835_delay(500);
-        
-        // PS_LOG_FMT("Loop %lu", loops);
-        loops++;
-        if(loops % 1000 == 0)
+        uint32_t start_bits = frame->bits[bank * 2];
+        uint32_t end_bits = frame->bits[bank * 2 + 1];
+        if (PS_LAST_BANK_MASK != PS_BANK_ALL_KEYS && bank == PS_NUMBER_OF_KEY_BANKS - 1)
         {
-            if (led_on)
-            {
-                RUN_LED_OFF();
-                led_on = false;
-            }
-            else
-            {
-                RUN_LED_ON();
-                led_on = true;
-            }
-            // PS_LOG_FMT("LED %s", led_on ? "On" : "Off");
+            start_bits &= PS_LAST_BANK_MASK;
+            end_bits &= PS_LAST_BANK_MASK;
         }
+        uint32_t started = bank_state[bank].started;
+        uint32_t hit = bank_state[bank].hit;
+        uint32_t releasing = bank_state[bank].releasing;
 
-        // uint8_t bits = GPIO_READ_BANK();
-        // PS_LOG_FMT("BANK BITS %2X", bits);
-
-        // start_time = READ_U32BIT_US_TIME();
+        // nothing down and nothing in progress
+        if (!(start_bits | end_bits | started | hit | releasing))
+        {
+            continue;
+        }
 
-        // Reset shift register and clock a 1 to output 0
-        GPIO__LOW(PS_SHIFT_REG_RESET_GPIO_NUMBER);
-        GPIO_HIGH(PS_SHIFT_REG_INPUT_GPIO_NUMBER);
-        GPIO_HIGH(PS_SHIFT_REG_RESET_GPIO_NUMBER);
-        GPIO_HIGH(PS_SHIFT_REG_CLOCK_GPIO_NUMBER); // Clock the bit into the shift regs
-        GPIO__LOW(PS_SHIFT_REG_CLOCK_GPIO_NUMBER);
-        GPIO_HIGH(PS_SHIFT_REG_LATCH_GPIO_NUMBER); // Latch the data out
-        GPIO__LOW(PS_SHIFT_REG_LATCH_GPIO_NUMBER);
-        GPIO__LOW(PS_SHIFT_REG_INPUT_GPIO_NUMBER);
+        // note that because  all arithmatic using the time is done modulo 2^32
+        // there is no need to account for timer roll over
+        // for example: assuming modulo 10 and the timer rolls over
+        // say start_time = 8 and end_time = 1
+        // end_time - start_time == 3
+        // this is the same as 10-8 + 1
+        uint32_t start_time = frame->time[bank * 2];
+        uint32_t end_time = frame->time[bank * 2 + 1];
+        uint32_t *bank_press_time = press_time[bank];
+        // keys whose event did not fit, put back in their old state at the end
+        uint32_t retry_started = 0;
+        uint32_t retry_hit = 0;
+        uint32_t retry_releasing = 0;
+        uint32_t retry_idle = 0;
+
+        // IDLE -> STARTED: start button down
+        uint32_t pressed = start_bits & ~(started | hit | releasing);
+        PS_FOR_EACH_KEY_IN(pressed, position)
+        {
+            bank_press_time[position] = start_time;
+            PS_PUSH_OR_RETRY(retry_idle, bank, position, PS_KEY_PRESS, start_time, 0);
+        }
+        pressed &= ~retry_idle;
 
-        uint8_t bank_bits;
-        for (size_t bank = 0; bank < PS_NUMBER_OF_KEY_BANKS; bank++)
+        // STARTED -> IDLE: start button up for longer than the debounce time
+        PS_FOR_EACH_KEY_IN(started & ~start_bits, position)
         {
-            // read start buttons of bank
-            bank_bits = GPIO_READ_BANK();
-            // note that because  all arithmatic using the time is done modulo 2^32
-            // there is no need to account for timer roll over
-            // for example: assuming modulo 10 and the timer rolls over
-            // say start_time = 8 and end_time = 1
-            // end_time - start_time == 3
-            // this is the same as 10-8 + 1
-            uint32_t current_time = READ_U32BIT_US_TIME();
-            // if any start buttons set
-            for (size_t position = 0; position < PS_NUMBER_OF_KEYS_PER_BANK; position++)
+            if (start_time - bank_press_time[position] > PS_DEBOUNCE_TIME_US)
             {
-                int key = bank * PS_NUMBER_OF_KEYS_PER_BANK + position;
-                // if the start key is down
-                bool button_down = bank_bits & (1 << position);
-
-                switch (key_data[key].state)
-                {
-                case PS_KEY_STATE_IDLE:
-                    if (button_down)
-                    {
-                        key_data[key].press_time = READ_U32BIT_US_TIME();
-                        key_data[key].state = PS_KEY_STATE_STARTED;
-                        PS_LOG_FMT("START: key:%i bank:%i, bit:%i ", key, bank, position);
-                    }
-                    break;
-                case PS_KEY_STATE_STARTED:
-                    if (!button_down && current_time - key_data[key].press_time > PS_DEBOUNCE_TIME_US)
-                    {
-                        key_data[key].state = PS_KEY_STATE_IDLE;
-                        PS_LOG_FMT("NO HIT: key:%i bank:%i, bit:%i", key, bank, position);
-                    }
-                    break;
-                case PS_KEY_STATE_HIT:
-                    if (!button_down)
-                    {
-                        key_data[key].state = PS_KEY_STATE_IDLE;
-                        PS_LOG_FMT("IDLE: key:%i bank:%i, bit:%i", key, bank, position);
-                        ps_send_note_off(key);
-                    }
-                    break;
-                }
+                started &= ~(1UL << position);
+                PS_PUSH_OR_RETRY(retry_started, bank, position, PS_KEY_NO_HIT, start_time, 0);
             }
+        }
 
-            // clock shift register to the end keys
-            GPIO_HIGH(PS_SHIFT_REG_CLOCK_GPIO_NUMBER); // Clock the shift reg
-            GPIO__LOW(PS_SHIFT_REG_CLOCK_GPIO_NUMBER);
-            GPIO_HIGH(PS_SHIFT_REG_LATCH_GPIO_NUMBER); // Latch the data out
-            GPIO__LOW(PS_SHIFT_REG_LATCH_GPIO_NUMBER);
+        // RELEASING -> IDLE: start button up, the release took from the end
+        // button opening until now
+        uint32_t released = releasing & ~start_bits;
+        releasing &= ~released;
+        PS_FOR_EACH_KEY_IN(released, position)
+        {
+            PS_PUSH_OR_RETRY(retry_releasing, bank, position, PS_KEY_RELEASE, start_time, start_time - bank_press_time[position]);
+        }
 
-            bcm2835_delayMicroseconds(10);
+        // HIT -> IDLE: both buttons opened within one pass, as fast as can be seen
+        released = hit & ~start_bits;
+        hit &= ~released;
+        PS_FOR_EACH_KEY_IN(released, position)
+        {
+            PS_PUSH_OR_RETRY(retry_hit, bank, position, PS_KEY_RELEASE, start_time, 0);
+        }
+        started |= pressed;
 
-            // read end buttons of bank
-            bank_bits = GPIO_READ_BANK();
-            current_time = READ_U32BIT_US_TIME();
-            if (bank_bits) // nothing to do if no end buttons down
-            {
-                for (size_t position = 0; position < PS_NUMBER_OF_KEYS_PER_BANK; position++)
-                {
-                    int key = bank * PS_NUMBER_OF_KEYS_PER_BANK + position;
-                    // if the end key is down
-                    bool button_down = bank_bits & (1 << position);
-
-                    switch (key_data[key].state)
-                    {
-                    case PS_KEY_STATE_IDLE:
-                        if (button_down)
-                        {
-                            // illegal state - something must be wrong - log error
-                            PS_LOG_FMT("ERROR end detected before start: key:%i bank:%i, bit:%i", key, bank, position);
-                        }
-                        break;
-                    case PS_KEY_STATE_STARTED:
-                        if (button_down)
-                        {
-                            uint32_t duration = current_time - key_data[key].press_time;
-                            key_data[key].state = PS_KEY_STATE_HIT;
-                            PS_LOG_FMT("HIT key:%i bank:%i, bit:%i, duration:%lu", key, bank, position, duration);
-                            ps_send_note_on(key, duration);
-
-                        }
-                        break;
-                    case PS_KEY_STATE_HIT:
-                        // do nothing as we wait for start button to go back to idle
-                        break;
-                    }
-                }
-            }
+        // HIT -> RELEASING: end button up, start timing the release
+        uint32_t lifting = hit & ~end_bits;
+        hit &= ~lifting;
+        releasing |= lifting;
+        PS_FOR_EACH_KEY_IN(lifting, position)
+        {
+            bank_press_time[position] = end_time;
+        }
 
-            // clock shift register to next bank
-            GPIO_HIGH(PS_SHIFT_REG_CLOCK_GPIO_NUMBER); // Clock the shift reg
-            GPIO__LOW(PS_SHIFT_REG_CLOCK_GPIO_NUMBER);
-            GPIO_HIGH(PS_SHIFT_REG_LATCH_GPIO_NUMBER); // Latch the data out
-            GPIO__LOW(PS_SHIFT_REG_LATCH_GPIO_NUMBER);
+        // RELEASING -> HIT: end button down again before the start button opened
+        uint32_t returned = releasing & end_bits;
+        releasing &= ~returned;
+        hit |= returned;
 
-            bcm2835_delayMicroseconds(10);
+#if PS_DEBUG_LOGGING
+        // illegal state - something must be wrong - log error
+        PS_FOR_EACH_KEY_IN(end_bits & ~(started | hit), position)
+        {
+            ps_events_push(bank * PS_NUMBER_OF_KEYS_PER_BANK + position, PS_KEY_END_BEFORE_START, end_time, 0);
         }
-        
-        // uint32_t end_time = READ_U32BIT_US_TIME();
-        // PS_LOG_FMT("Start %lu end %lu", start_time, end_time);
-        // PS_LOG_FMT("Elapsed %lu", end_time - start_time);
+#endif
+
+        // STARTED -> HIT: end button down
+        uint32_t struck = started & end_bits;
+        started &= ~struck;
+        hit |= struck;
+        PS_FOR_EACH_KEY_IN(struck, position)
+        {
+            PS_PUSH_OR_RETRY(retry_started, bank, position, PS_KEY_STRIKE, end_time, end_time - bank_press_time[position]);
+        }
+        hit &= ~retry_started;
+
+        bank_state[bank].started = started | retry_started;
+        bank_state[bank].hit = hit | retry_hit;
+        bank_state[bank].releasing = releasing | retry_releasing;
     }
-}
\ No newline at end of file
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef PS_DEBUG_LOGGING
 #define PS_DEBUG_LOGGING 1
+#endif
 
 //#define PS_LOG(format, ... ) printf(format "\n\r", __VA_ARGS__)
 /* #define PS_LOG(...) \
@@ -8,21 +13,90 @@
            __LINE__, __func__, __VA_ARGS__); } while (0)
             */
 
+// Log lines are recorded raw and formatted later at low priority (see
+// ps_log.h), then go out on the uart through the diagnostic output class,
+// behind any midi (see ps_output.h). At most PS_LOG_MAX_ARGS integer or pointer
+// arguments. The ps_output_printf() call is never made, it only has the
+// compiler check the arguments against the format.
+void ps_output_printf(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+
+#define PS_LOG_MAX_ARGS 6
+bool ps_log_write(const char *format, const uintptr_t args[PS_LOG_MAX_ARGS]);
+
+#define PS_LOG_COUNT_(a0, a1, a2, a3, a4, a5, a6, a7, count, ...) count
+#define PS_LOG_COUNT(...) PS_LOG_COUNT_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define PS_LOG_ARGS_(a0, a1, a2, a3, a4, a5, ...) \
+            (uintptr_t)(a0), (uintptr_t)(a1), (uintptr_t)(a2), (uintptr_t)(a3), (uintptr_t)(a4), (uintptr_t)(a5)
+#define PS_LOG_ARGS(...) PS_LOG_ARGS_(__VA_ARGS__, 0, 0, 0, 0, 0, 0)
 #define PS_LOG_FMT(fmt, ...) \
-            do { if (PS_DEBUG_LOGGING) fprintf(stderr, fmt "\n\r", __VA_ARGS__); } while (0)
+            do { \
+                _Static_assert(PS_LOG_COUNT(__VA_ARGS__) <= PS_LOG_MAX_ARGS, "too many arguments for PS_LOG_FMT"); \
+                if (0) ps_output_printf(fmt, __VA_ARGS__); \
+                if (PS_DEBUG_LOGGING) ps_log_write(fmt "\n\r", (const uintptr_t[PS_LOG_MAX_ARGS]){ PS_LOG_ARGS(__VA_ARGS__) }); \
+            } while (0)
 
-// This sets the number of shifts done in the shift register starting from the first bit
-#define PS_NUMBER_OF_KEY_BANKS 10
+// Size of the keyboard action. 61, 76 and 88 key actions are supported as well
+// as the 80 scan positions (10 banks of 8) wired on the EP-50 board. A part
+// filled last bank has its unused positions ignored.
+#ifndef PS_KEYBOARD_KEYS
+#define PS_KEYBOARD_KEYS 80
+#endif
 
-// This number needs to stay the same unless the defines below are also changed
+// Keys read at once, one per key input line (PS_KEY_INPUT_GPIOS). The EP-50
+// board has 8 keys on each make and break line. An action wired with more
+// keys per line, each on its own input, needs fewer shift steps for the whole
+// keyboard and scans it proportionally faster.
+#ifndef PS_NUMBER_OF_KEYS_PER_BANK
 #define PS_NUMBER_OF_KEYS_PER_BANK 8
+#endif
+
+// This sets the number of shifts done in the shift register starting from the first bit
+#define PS_NUMBER_OF_KEY_BANKS ((PS_KEYBOARD_KEYS + PS_NUMBER_OF_KEYS_PER_BANK - 1) / PS_NUMBER_OF_KEYS_PER_BANK)
 
-// Uses R-Pi1 B+ V1.2 GPIO 2 to 9 to get consecutive bits in the gpio port
-// If consecutive ports/bits are not available the port reading part of the code 
-// will need to be re-written. The defines below also assume PS_NUMBER_OF_KEYS_PER_BANK is 8
-#define PS_KEY_0_PORT_GPIO_NUMBER 4 
-#define PS_KEY_7_PORT_GPIO_NUMBER 11
-#define PS_KEY_PORT_MASK (0x000000FF << PS_KEY_0_PORT_GPIO_NUMBER)
+#define PS_NUMBER_OF_KEYS PS_KEYBOARD_KEYS
+
+// One bit per key of a bank, bit n for the key on input line n
+#if PS_NUMBER_OF_KEYS_PER_BANK <= 8
+typedef uint8_t ps_bank_bits_t;
+#elif PS_NUMBER_OF_KEYS_PER_BANK <= 16
+typedef uint16_t ps_bank_bits_t;
+#elif PS_NUMBER_OF_KEYS_PER_BANK <= 32
+typedef uint32_t ps_bank_bits_t;
+#else
+#error "PS_NUMBER_OF_KEYS_PER_BANK can be at most 32"
+#endif
+
+// All the keys of a bank, and those present in the last bank
+#define PS_BANK_ALL_KEYS (0xFFFFFFFFu >> (32 - PS_NUMBER_OF_KEYS_PER_BANK))
+#define PS_LAST_BANK_MASK (PS_BANK_ALL_KEYS >> (PS_NUMBER_OF_KEY_BANKS * PS_NUMBER_OF_KEYS_PER_BANK - PS_NUMBER_OF_KEYS))
+
+// Shift register drive. By default the chain is bit-banged on the four control
+// lines below, one output further along per clock. With PS_SHIFT_REG_SPI the
+// chain's data, clock and latch are wired to SPI0 MOSI, SCLK and CE0 instead
+// (drivers/bcm2835_spi_shiftreg.h) and each step of the scan writes the whole
+// output word in one transfer. The reset line stays on its gpio, held high.
+#ifndef PS_SHIFT_REG_SPI
+#define PS_SHIFT_REG_SPI 0
+#endif
+// 250MHz core clock / 16, within what a 74HC595 takes at 3.3V
+#define PS_SHIFT_REG_SPI_CLOCK_DIVIDER 16
+// SPI0 CE1, CE0, MISO, MOSI and SCLK are GPIO 7 to 11
+#define PS_SPI0_GPIO_MASK (0x1Fu << 7)
+
+// The gpio each key input line is wired to, line 0 first, one per key in a
+// bank. Any gpios will do (see ps_pins.c) but runs of consecutive gpios are
+// read together, so the default R-Pi1 B+ V1.2 GPIO 4 to 11 is a single shift
+// and mask. With 16 keys a bank GPIO 4 to 11 and 16 to 23 fit alongside the
+// shift register and uart pins. SPI0 needs GPIO 7 to 11, so with
+// PS_SHIFT_REG_SPI the default moves to GPIO 16 to 23; ps_init() refuses to
+// start the scan if the key inputs overlap SPI0.
+#ifndef PS_KEY_INPUT_GPIOS
+#if PS_SHIFT_REG_SPI
+#define PS_KEY_INPUT_GPIOS 16, 17, 18, 19, 20, 21, 22, 23
+#else
+#define PS_KEY_INPUT_GPIOS 4, 5, 6, 7, 8, 9, 10, 11
+#endif
+#endif
 
 // Control pins for MC595 Shift Registers
 // Three devices are used daisy chained to provide 24 outputs
@@ -33,43 +107,173 @@
 #define PS_SHIFT_REG_INPUT_GPIO_NUMBER 3
 #define PS_SHIFT_REG_CLOCK_GPIO_NUMBER 12
 #define PS_SHIFT_REG_LATCH_GPIO_NUMBER 13
+#define PS_SHIFT_REG_OUTPUTS 24
+
+// The control lines are driven with whole mask writes to GPSET0/GPCLR0, so
+// they must all be in the first gpio bank
+#if PS_SHIFT_REG_RESET_GPIO_NUMBER > 31 || PS_SHIFT_REG_INPUT_GPIO_NUMBER > 31 || \
+    PS_SHIFT_REG_CLOCK_GPIO_NUMBER > 31 || PS_SHIFT_REG_LATCH_GPIO_NUMBER > 31
+#error "The shift register control lines must be GPIO 0 to 31"
+#endif
+#define PS_SHIFT_REG_RESET_MASK (1u << PS_SHIFT_REG_RESET_GPIO_NUMBER)
+#define PS_SHIFT_REG_INPUT_MASK (1u << PS_SHIFT_REG_INPUT_GPIO_NUMBER)
+#define PS_SHIFT_REG_CLOCK_MASK (1u << PS_SHIFT_REG_CLOCK_GPIO_NUMBER)
+#define PS_SHIFT_REG_LATCH_MASK (1u << PS_SHIFT_REG_LATCH_GPIO_NUMBER)
+
+#if PS_NUMBER_OF_KEY_BANKS * 2 > PS_SHIFT_REG_OUTPUTS
+#error "Each bank needs two shift register outputs, PS_KEYBOARD_KEYS is too big for the chain"
+#endif
 
+#if PS_SHIFT_REG_SPI && (PS_SHIFT_REG_OUTPUTS % 8 || PS_SHIFT_REG_OUTPUTS > 32)
+#error "The SPI shift register drive sends whole bytes of a 32 bit word"
+#endif
+
+
+// Scan timing. The scan is paced by a system timer compare channel (channels
+// 0 and 2 belong to the GPU). Each period energises the next half bank and gives
+// its lines this long to settle before they are sampled, so a full pass over the
+// keyboard takes PS_NUMBER_OF_KEY_BANKS * 2 * PS_SCAN_HALF_BANK_PERIOD_US.
+// The period must comfortably exceed the cost of the scan interrupt. 10us is
+// the settle time the busy waiting scan loop this replaced gave each half bank.
+#define PS_SCAN_TIMER _SYSTIMER1
+#ifndef PS_SCAN_HALF_BANK_PERIOD_US
+#define PS_SCAN_HALF_BANK_PERIOD_US 10
+#endif
+
+// Edge detect scanning. A plain sample only sees a switch that is closed at the
+// instant its half bank is read. With this set, rising edge detect is armed on
+// the key inputs and each sample also takes in the edges latched while its half
+// bank was energised, so a contact that closes and opens again within the
+// period still counts as closed. The input lines carry whichever half bank is
+// energised, so nothing can be seen of a switch outside its own period.
+#ifndef PS_SCAN_EDGE_DETECT
+#define PS_SCAN_EDGE_DETECT 0
+#endif
 
 #define LED_PIN 47
 
-#define PS_STARTING_NOTE_MIDI_NUMBER 22
+// Midi uart. Midi, diagnostic text and commands share GPIO 14 and 15, driven
+// by the mini uart at 115200 baud (its divisor is fixed in the driver and
+// follows the core clock). With PS_MIDI_UART_PL011 they go through the PL011
+// (drivers/bcm2835_pl011.h) instead, clocked from its own reference at
+// PS_MIDI_UART_BAUD, 31250 for a DIN midi port. Its transmit interrupt fires
+// when the FIFO is down to PS_MIDI_UART_PL011_TX_LEVEL bytes and queues
+// PS_MIDI_UART_PL011_TX_BATCH more, so a note-on waits behind at most 2 + 4
+// bytes in the FIFO (1.9ms at 31250), not the 16 it could hold.
+#ifndef PS_MIDI_UART_PL011
+#define PS_MIDI_UART_PL011 0
+#endif
+// The PL011 reference clock, which has to match the firmware's. The firmware
+// sets it to 48MHz unless config.txt on the boot partition has, for example,
+//   init_uart_clock=3000000
+// in which case build with PS_MIDI_UART_PL011_CLOCK_HZ=3000000.
+#ifndef PS_MIDI_UART_PL011_CLOCK_HZ
+#define PS_MIDI_UART_PL011_CLOCK_HZ 48000000
+#endif
+#ifndef PS_MIDI_UART_BAUD
+#if PS_MIDI_UART_PL011
+#define PS_MIDI_UART_BAUD 31250
+#else
+#define PS_MIDI_UART_BAUD 115200
+#endif
+#endif
+#define PS_MIDI_UART_PL011_TX_LEVEL BCM2835_PL011_FIFO_1_8
+#define PS_MIDI_UART_PL011_TX_BATCH 4
+#define PS_MIDI_UART_PL011_RX_LEVEL BCM2835_PL011_FIFO_1_2
 
-#define PS_DEBOUNCE_TIME_US 2000
+// DMA stdio. With PS_DUMP_DMA, and the PL011 as the midi uart, printf text
+// (the stats and calibration dumps) is sent by a DMA channel in runs of up to
+// PS_DUMP_DMA_CHUNK bytes whenever the midi queues are empty, instead of by the
+// tx interrupt a few bytes at a time (ps_dump.h). A note waits behind at most
+// one run, 20ms at 31250 baud.
+#ifndef PS_DUMP_DMA
+#define PS_DUMP_DMA 0
+#endif
+#define PS_DUMP_DMA_CHUNK 64
+#if PS_DUMP_DMA && !PS_MIDI_UART_PL011
+#error "PS_DUMP_DMA needs PS_MIDI_UART_PL011, the mini uart has no DMA request"
+#endif
+
+// Longest the command task waits for a command before flushing the log
+#define PS_COMMAND_POLL_MS 50
 
-#define PS_MIDI_OUT_BUFFER_SIZE_BYTES 1024
+#define PS_DEBOUNCE_TIME_US 2000
 
 //Channel must be 0 to 15
 #define PS_MIDI_CHANNEL 0
 // Subset of Midi codes
 #define MIDI_STATUS_NOTE_ON(ch) (0x90 | ch)
 #define MIDI_STATUS_NOTE_OFF(ch) (0x80 | ch)
+#define MIDI_STATUS_CONTROL_CHANGE(ch) (0xB0 | ch)
+// Controller carrying the low 7 bits of the next note message's velocity
+#define MIDI_CC_HIGH_RES_VELOCITY_PREFIX 88
+
+// Running status: a message with the same status byte as the one before it is
+// sent without it. Without PS_MIDI_RELEASE_VELOCITY note-offs are sent as
+// note-ons with velocity 0 so key presses and releases on the channel all share
+// one status, which cuts a busy passage from 3 to 2 bytes a note. Anything else
+// written to the uart breaks the receiver's running status, so
+// ps_output_next_byte() forgets it whenever it sends diagnostic text or hands
+// the uart to a bulk transfer.
+#ifndef PS_MIDI_RUNNING_STATUS
+#define PS_MIDI_RUNNING_STATUS 1
+#endif
+// Send note-offs as real note-off messages carrying the release velocity. They
+// then have their own status byte, so running status only saves bytes between
+// runs of presses or of releases.
+#ifndef PS_MIDI_RELEASE_VELOCITY
+#define PS_MIDI_RELEASE_VELOCITY 1
+#endif
+// High resolution velocity: every note message is preceded by a high resolution
+// velocity prefix controller (CC 88) holding the next 7 bits of its velocity,
+// so the receiver gets the 14 bit velocity from the fine velocity tables.
+// Costs 3 bytes a note, and as the controller and note status alternate
+// running status no longer saves anything. This sets the mode at start up, it
+// can be switched with ps_set_high_res_velocity().
+#ifndef PS_MIDI_HIGH_RES_VELOCITY
+#define PS_MIDI_HIGH_RES_VELOCITY 0
+#endif
 // This value is the midi note of the zeroth key
+#ifndef PS_MIDI_NOTE_KEY0_OFFSET
+#if PS_KEYBOARD_KEYS == 88
+#define PS_MIDI_NOTE_KEY0_OFFSET 21 // A0
+#elif PS_KEYBOARD_KEYS == 76
+#define PS_MIDI_NOTE_KEY0_OFFSET 28 // E1
+#elif PS_KEYBOARD_KEYS == 61
+#define PS_MIDI_NOTE_KEY0_OFFSET 36 // C2
+#else
 #define PS_MIDI_NOTE_KEY0_OFFSET 22
-// Velocity Mapping
+#endif
+#endif
+// Velocity Mapping, the range of make to break times of the default
+// profiles in ps_velocity.c
 #define PS_MAX_KEY_TIME_US 80000
 #define PS_MIN_KEY_TIME_US 2900
+// Break to make times as a key is let up. A key rises on its spring alone so
+// releases span a narrower range than strikes. Not yet measured on the EP-50.
+#define PS_MAX_RELEASE_TIME_US 40000
+#define PS_MIN_RELEASE_TIME_US 1000
 #define MIDI_MAX_VELOCITY 127
 #define MIDI_MIN_VELOCITY 1
-#define PS_VELOCITY_MAPPING_SLOPE (((double)MIDI_MIN_VELOCITY-MIDI_MAX_VELOCITY)/(double)(PS_MAX_KEY_TIME_US - PS_MIN_KEY_TIME_US))
-#define PS_VELOCITY_MAPPING_OFFSET ((-PS_MAX_KEY_TIME_US * PS_VELOCITY_MAPPING_SLOPE) + MIDI_MIN_VELOCITY)
-
 
-// Abstraction of system calls
-#define GPIO_HIGH(pin)  bcm2835_gpio_set(pin)
-#define GPIO__LOW(pin)  bcm2835_gpio_clr(pin)
-#define GPIO_READ_BANK() (bcm2835_peri_read(bcm2835_gpio + BCM2835_GPLEV0/4) & PS_KEY_PORT_MASK) >> PS_KEY_0_PORT_GPIO_NUMBER;  
-#define READ_U32BIT_US_TIME() 	bcm2835_peri_read(bcm2835_st + BCM2835_ST_CLO/4)
-#define RUN_LED_ON() bcm2835_gpio_set(LED_PIN)
-#define RUN_LED_OFF() bcm2835_gpio_clr(LED_PIN)
-#define UART_TX_READY() bcm2835_miniuart_is_transmitter_empty()
-#define UART_TX_CHAR(c) bcm2835_miniuart_sendchar(c)
 
 #define PS_SATURATE(max, min, val) (val = val > max ? max : (val < min ? min : val))
 
 
+// Abstraction of system calls, see ps_hal.h
+#include "ps_hal.h"
+
+struct ps_scan_frame;
+
 void ps_init(void);
+
+// Key state machine and midi output (piano_scanner.c). These only touch the
+// hardware through ps_hal.h so they build for the host simulator too.
+void ps_reset_key_states(void);
+// Sets up the key event queue with the midi, statistics and (with
+// PS_DEBUG_LOGGING) log handlers
+void ps_init_key_events(void);
+char ps_map_key_to_note(int key);
+void ps_set_high_res_velocity(bool on);
+bool ps_high_res_velocity(void);
+void ps_process_frame(const struct ps_scan_frame *frame);
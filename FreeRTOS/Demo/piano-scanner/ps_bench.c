@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "piano_scanner.h"
+#include "ps_scan.h"
+#include "ps_bench.h"
+#include "ps_output.h"
+#include "drivers/bcm2835.h"
+
+// ARM1176 cycle counter, CCNT in the CP15 c15 performance monitor
+static void ps_bench_cycles_reset(void)
+{
+    uint32_t pmnc = 1 | 4; // enable the counters, reset CCNT
+    __asm__ volatile ("mcr p15, 0, %0, c15, c12, 0" : : "r" (pmnc));
+}
+
+static uint32_t ps_bench_cycles(void)
+{
+    uint32_t cycles;
+    __asm__ volatile ("mrc p15, 0, %0, c15, c12, 1" : "=r" (cycles));
+    return cycles;
+}
+
+static uint32_t ps_bench_step_ns(uint32_t elapsed_us)
+{
+    return (uint32_t)((uint64_t)elapsed_us * 1000 / PS_BENCH_SHIFT_STEPS);
+}
+
+void ps_bench_shift_register(void)
+{
+    uint32_t start = READ_U32BIT_US_TIME();
+    for (uint32_t i = 0; i < PS_BENCH_SHIFT_STEPS; i++)
+    {
+        ps_scan_shift_gpio_advance();
+    }
+    uint32_t gpio_us = READ_U32BIT_US_TIME() - start;
+    printf("Shift register gpio advance : %" PRIu32 "ns\n\r", ps_bench_step_ns(gpio_us));
+
+#if PS_SHIFT_REG_SPI
+    start = READ_U32BIT_US_TIME();
+    for (uint32_t i = 0; i < PS_BENCH_SHIFT_STEPS; i++)
+    {
+        ps_scan_shift_spi_write(i % PS_SCAN_HALF_BANKS);
+    }
+    uint32_t spi_us = READ_U32BIT_US_TIME() - start;
+    printf("Shift register spi write : %" PRIu32 "ns\n\r", ps_bench_step_ns(spi_us));
+#endif
+}
+
+void ps_bench_register_access(void)
+{
+    volatile uint32_t *levels = bcm2835_gpio + BCM2835_GPLEV0/4;
+    volatile uint32_t sink;
+    uint32_t start;
+
+    ps_bench_cycles_reset();
+
+    start = ps_bench_cycles();
+    for (uint32_t i = 0; i < PS_BENCH_ACCESSES; i++)
+    {
+        sink = *levels;
+    }
+    uint32_t bare = ps_bench_cycles() - start;
+
+    start = ps_bench_cycles();
+    for (uint32_t i = 0; i < PS_BENCH_ACCESSES; i++)
+    {
+        sink = bcm2835_peri_read(levels);
+    }
+    uint32_t read = ps_bench_cycles() - start;
+
+    start = ps_bench_cycles();
+    for (uint32_t i = 0; i < PS_BENCH_ACCESSES; i++)
+    {
+        sink = bcm2835_gpio_lev(PS_SHIFT_REG_LATCH_GPIO_NUMBER);
+    }
+    uint32_t lev = ps_bench_cycles() - start;
+
+    // setting no pins is a store with no effect
+    start = ps_bench_cycles();
+    for (uint32_t i = 0; i < PS_BENCH_ACCESSES; i++)
+    {
+        bcm2835_gpio_set_multi(0);
+    }
+    uint32_t set = ps_bench_cycles() - start;
+    (void)sink;
+
+    printf("Register access, debug accessors %i, cycles per call\n\r", BCM2835_DEBUG_ACCESS);
+    printf("  volatile load : %" PRIu32 "\n\r", bare / PS_BENCH_ACCESSES);
+    printf("  bcm2835_peri_read : %" PRIu32 "\n\r", read / PS_BENCH_ACCESSES);
+    printf("  bcm2835_gpio_lev : %" PRIu32 "\n\r", lev / PS_BENCH_ACCESSES);
+    printf("  bcm2835_gpio_set_multi : %" PRIu32 "\n\r", set / PS_BENCH_ACCESSES);
+}
+
+void ps_bench_uart(void)
+{
+    static const char text[PS_OUTPUT_RECORD_DATA + 1] = "uartbench\n\r";
+    const uint32_t empty = PS_OUTPUT_DIAGNOSTIC_RECORDS * PS_OUTPUT_RECORD_DATA;
+
+    uint32_t idle_spins = 0;
+    uint32_t start = READ_U32BIT_US_TIME();
+    while (READ_U32BIT_US_TIME() - start < PS_BENCH_UART_IDLE_US)
+    {
+        (void)ps_output_free(PS_OUTPUT_DIAGNOSTIC);
+        idle_spins++;
+    }
+
+    // queues the text a record at a time as room is made, then waits for
+    // the queue to drain; the last few bytes in the uart fifo are not timed
+    uint32_t spins = 0;
+    uint32_t queued = 0;
+    start = READ_U32BIT_US_TIME();
+    while (queued < PS_BENCH_UART_BYTES || ps_output_free(PS_OUTPUT_DIAGNOSTIC) < empty)
+    {
+        if (queued < PS_BENCH_UART_BYTES && ps_output_free(PS_OUTPUT_DIAGNOSTIC) >= PS_OUTPUT_RECORD_DATA)
+        {
+            ps_output_send(PS_OUTPUT_DIAGNOSTIC, (const uint8_t *)text, PS_OUTPUT_RECORD_DATA);
+            queued += PS_OUTPUT_RECORD_DATA;
+        }
+        spins++;
+    }
+    uint32_t elapsed = READ_U32BIT_US_TIME() - start;
+    ps_output_reset_stats();
+
+    // the spins the loop would have made in that time with the uart idle
+    uint64_t idle = (uint64_t)idle_spins * elapsed / PS_BENCH_UART_IDLE_US;
+    uint32_t busy_percent = spins < idle ? (uint32_t)((idle - spins) * 100 / idle) : 0;
+    printf("Uart %s %" PRIu32 " baud : %" PRIu32 " bytes in %" PRIu32 "us, %" PRIu32 " of %" PRIu32 " bytes/s, cpu %" PRIu32 "%%\n\r",
+           PS_MIDI_UART_PL011 ? "pl011" : "mini", (uint32_t)PS_MIDI_UART_BAUD, queued, elapsed,
+           (uint32_t)((uint64_t)queued * 1000000 / elapsed), (uint32_t)PS_MIDI_UART_BAUD / 10, busy_percent);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "piano_scanner.h"
+
+// Timing of the scan's building blocks on the target, printed on the uart.
+// Run from the producer task before it starts the scan timer, so only the uart
+// interrupt and the scheduler tick can get in the way.
+
+// Steps timed for each shift register drive
+#define PS_BENCH_SHIFT_STEPS 10000
+
+// Accesses timed for each register accessor
+#define PS_BENCH_ACCESSES 1000
+
+// Bytes sent by the uart benchmark, and how long its busy loop is timed alone
+#define PS_BENCH_UART_BYTES 2048
+#define PS_BENCH_UART_IDLE_US 10000
+
+#ifndef PS_BENCH_AT_BOOT
+#define PS_BENCH_AT_BOOT 0
+#endif
+
+// Time per scan step of the bit-banged shift register drive and, with
+// PS_SHIFT_REG_SPI, of the SPI drive. The SPI pins are key inputs otherwise, so
+// the SPI drive can only be timed in a build that uses it. Leaves the chain in
+// any state; the producer task resets it before the scan starts.
+void ps_bench_shift_register(void);
+
+// Cpu cycles per call of the bcm2835 register and gpio accessors on the scan's
+// hot path, against a bare volatile load. Built with BCM2835_DEBUG_ACCESS the
+// accessors are out of line and test the library's debug flag, so running
+// this in both builds gives the saving per access. Needs a privileged mode for
+// the cycle counter.
+void ps_bench_register_access(void);
+
+// Throughput of the interrupt driven midi uart, the mini uart or with
+// PS_MIDI_UART_PL011 the PL011, against its line rate, and the share of the cpu
+// taken by its interrupt and queuing the bytes: how much slower a busy loop
+// runs while the uart is kept busy. Running this in both builds compares the
+// two. The test text goes out on the uart.
+void ps_bench_uart(void);
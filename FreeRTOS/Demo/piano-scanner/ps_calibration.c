@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "piano_scanner.h"
+#include "ps_calibration.h"
+#include "ps_velocity.h"
+#include "ps_stats.h"
+
+typedef struct
+{
+    uint32_t hits;
+    // shortest and longest times so far, shortest/longest first
+    uint32_t shortest[PS_CALIBRATION_OUTLIERS];
+    uint32_t longest[PS_CALIBRATION_OUTLIERS];
+} ps_calibration_key_t;
+
+static ps_calibration_key_t keys[PS_NUMBER_OF_KEYS];
+static volatile bool active;
+
+void ps_calibration_start(void)
+{
+    active = false;
+    memset(keys, 0, sizeof(keys));
+    for (int key = 0; key < PS_NUMBER_OF_KEYS; key++)
+    {
+        for (int i = 0; i < PS_CALIBRATION_OUTLIERS; i++)
+        {
+            keys[key].shortest[i] = UINT32_MAX;
+        }
+    }
+    active = true;
+}
+
+bool ps_calibration_active(void)
+{
+    return active;
+}
+
+// Keeps the PS_CALIBRATION_OUTLIERS most extreme times in a sorted list,
+// shortest first when shorter is true, longest first otherwise
+static void ps_calibration_insert(uint32_t *list, bool shorter, uint32_t duration)
+{
+    for (int i = 0; i < PS_CALIBRATION_OUTLIERS; i++)
+    {
+        if (shorter ? duration < list[i] : duration > list[i])
+        {
+            uint32_t swap = list[i];
+            list[i] = duration;
+            duration = swap;
+        }
+    }
+}
+
+void ps_calibration_key_hit(int key, uint32_t duration)
+{
+    if (!active)
+    {
+        return;
+    }
+    keys[key].hits++;
+    ps_calibration_insert(keys[key].shortest, true, duration);
+    ps_calibration_insert(keys[key].longest, false, duration);
+}
+
+int ps_calibration_stop(void)
+{
+    active = false;
+
+    int profile = ps_velocity_selected_profile();
+    const ps_velocity_profile_t *p = ps_velocity_profile(profile);
+    uint32_t profile_range = p->max_time_us - p->min_time_us;
+    int calibrated = 0;
+
+    for (int key = 0; key < PS_NUMBER_OF_KEYS; key++)
+    {
+        ps_calibration_key_t *k = &keys[key];
+        uint32_t key_min = k->shortest[PS_CALIBRATION_OUTLIERS - 1];
+        uint32_t key_max = k->longest[PS_CALIBRATION_OUTLIERS - 1];
+        if (k->hits < PS_CALIBRATION_MIN_HITS || key_max <= key_min)
+        {
+            continue;
+        }
+
+        // key_min maps to the profile's min time and key_max to its max time
+        uint32_t scale = (uint32_t)(((uint64_t)profile_range << PS_VELOCITY_SCALE_SHIFT) / (key_max - key_min));
+        if (scale > UINT16_MAX || scale < 1)
+        {
+            // The key's range is under a sixteenth of the profile's, or over
+            // PS_VELOCITY_SCALE_ONE times it; it gets the nearest scale the
+            // table can hold
+            ps_stats_calibration_saturated();
+            PS_SATURATE(UINT16_MAX, 1, scale);
+        }
+        ps_velocity_calibration_t calibration;
+        calibration.scale = (uint16_t)scale;
+        calibration.offset = (int32_t)p->min_time_us - (int32_t)(((uint64_t)key_min * scale) >> PS_VELOCITY_SCALE_SHIFT);
+        ps_velocity_set_key_calibration(key, calibration);
+        calibrated++;
+    }
+    return calibrated;
+}
+
+void ps_calibration_dump(void)
+{
+    printf("// ps_calibration_table.h: { scale, offset } per key, profile %s\n\r",
+           ps_velocity_profile(ps_velocity_selected_profile())->name);
+    for (int key = 0; key < PS_NUMBER_OF_KEYS; key++)
+    {
+        ps_velocity_calibration_t calibration = ps_velocity_key_calibration(key);
+        printf("{ %u, %" PRIi32 " }, // key %i", calibration.scale, calibration.offset, key);
+        if (keys[key].hits)
+        {
+            printf(" hits:%" PRIu32 " %" PRIu32 "-%" PRIu32 "us", keys[key].hits,
+                   keys[key].shortest[PS_CALIBRATION_OUTLIERS - 1], keys[key].longest[PS_CALIBRATION_OUTLIERS - 1]);
+        }
+        printf("\n\r");
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "piano_scanner.h"
+
+// Per-key velocity calibration. While a session runs, every hit's make to
+// break time is recorded against its key. Stopping the session derives a
+// calibration for each key that has been played enough, so that the key's own
+// softest and hardest strokes reach the ends of the velocity profile, and hands
+// it to the velocity engine.
+//
+// To reject a stray bounce or a key bashed once, the range of a key is taken as
+// its PS_CALIBRATION_OUTLIERS-th shortest and longest times rather than the
+// extremes.
+
+#define PS_CALIBRATION_OUTLIERS 3
+// Keys with fewer hits than this keep their current calibration
+#define PS_CALIBRATION_MIN_HITS 8
+
+// Start a session when the scanner starts (ps_init) rather than on command
+#ifndef PS_CALIBRATE_AT_BOOT
+#define PS_CALIBRATE_AT_BOOT 0
+#endif
+
+void ps_calibration_start(void);
+
+// Ends the session and applies the calibration of every key with enough hits.
+// Returns the number of keys calibrated.
+int ps_calibration_stop(void);
+
+bool ps_calibration_active(void);
+
+// Called by the scanner with every hit
+void ps_calibration_key_hit(int key, uint32_t duration);
+
+// Prints the velocity engine's current calibration as the body of a C
+// initializer, to be saved as ps_calibration_table.h
+void ps_calibration_dump(void);
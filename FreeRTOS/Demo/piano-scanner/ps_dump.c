@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "piano_scanner.h"
+#include "ps_dump.h"
+
+#if PS_DUMP_DMA
+
+#include "ps_ring.h"
+#include "ps_output.h"
+#include "bcm2835_dma.h"
+#include "bcm2835_pl011.h"
+
+#if !PS_RING_IS_POWER_OF_TWO(PS_DUMP_QUEUE_CHARS)
+#error "PS_DUMP_QUEUE_CHARS must be a power of two"
+#endif
+
+// The oldest queued text is being read in place by the DMA transfer, so it
+// cannot be thrown away to make room
+#if PS_OUTPUT_WRITE_POLICY == PS_OUTPUT_WRITE_OVERWRITE
+#error "PS_DUMP_DMA does not support PS_OUTPUT_WRITE_OVERWRITE, use DROP or BLOCK"
+#endif
+
+static uint32_t storage[PS_DUMP_QUEUE_CHARS];
+static ps_ring_t queue;
+static int channel = -1;
+static bcm2835_dma_cb control_block;
+// ring bytes the running transfer is reading in place
+static uint32_t in_flight;
+
+static struct
+{
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t wait_ms;
+    uint32_t transfers;
+} stats;
+
+// Runs in interrupt context, from the uart tx handler once the output queues
+// are empty
+static bool ps_dump_start(void)
+{
+    const uint8_t *words;
+    uint32_t length = ps_ring_contiguous(&queue, &words);
+    PS_SATURATE(PS_DUMP_DMA_CHUNK * sizeof(uint32_t), 0, length);
+    if (length == 0)
+    {
+        return false;
+    }
+    in_flight = length;
+    bcm2835_pl011_dma_tx_cb(&control_block, (const uint32_t *)words, length / sizeof(uint32_t));
+    control_block.ti |= BCM2835_DMA_TI_INTEN;
+    bcm2835_dma_start(channel, &control_block);
+    stats.transfers++;
+    return true;
+}
+
+// Runs in interrupt context when the last word of a transfer is in the
+// uart fifo
+static void ps_dump_done(int dma_channel, void *param)
+{
+    ps_ring_skip(&queue, in_flight);
+    ps_output_bulk_done();
+}
+
+void ps_dump_init(void)
+{
+    ps_ring_init(&queue, (uint8_t *)storage, sizeof(storage));
+    ps_dump_reset_stats();
+    channel = bcm2835_dma_channel_alloc();
+    if (channel < 0)
+    {
+        printf("No DMA channel for stdio\n\r");
+        return;
+    }
+    bcm2835_dma_set_handler(channel, ps_dump_done, NULL);
+    bcm2835_pl011_enable_tx_dma(true);
+    ps_output_set_bulk_handler(ps_dump_start);
+}
+
+size_t ps_dump_write(const char *text, size_t length)
+{
+    size_t queued = 0;
+    uint32_t waited_ms = 0;
+    if (channel < 0)
+    {
+        return ps_output_write(text, length);
+    }
+    while (queued < length)
+    {
+        uint32_t word = (uint8_t)text[queued];
+        if (ps_ring_push(&queue, &word, sizeof(word)))
+        {
+            queued++;
+            continue;
+        }
+        UART_TX_START();
+#if PS_OUTPUT_WRITE_POLICY == PS_OUTPUT_WRITE_BLOCK
+        if (waited_ms < PS_OUTPUT_WRITE_TIMEOUT_MS)
+        {
+            TASK_DELAY_MS(1);
+            waited_ms++;
+            continue;
+        }
+#endif
+        break;
+    }
+    UART_TX_START();
+    stats.written += queued;
+    stats.dropped += length - queued;
+    stats.wait_ms += waited_ms;
+    return queued;
+}
+
+void ps_dump_print_stats(void)
+{
+    printf("Dump dma: channel:%i written:%" PRIu32 " dropped:%" PRIu32 " waited:%" PRIu32 "ms transfers:%" PRIu32 "\n\r",
+           channel, stats.written, stats.dropped, stats.wait_ms, stats.transfers);
+}
+
+void ps_dump_reset_stats(void)
+{
+    stats.written = 0;
+    stats.dropped = 0;
+    stats.wait_ms = 0;
+    stats.transfers = 0;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "piano_scanner.h"
+
+// DMA stdio for PS_DUMP_DMA builds. Text is queued one character to a 32 bit
+// word, as the DMA engine moves whole words and the PL011 data register takes
+// the low byte. When the output queues run dry the uart tx handler hands the
+// uart to ps_dump (see ps_output_set_bulk_handler()), which sends the oldest
+// PS_DUMP_DMA_CHUNK characters on a DMA channel paced by the uart's transmit
+// DREQ. The channel's completion interrupt hands the uart back. A dump of a
+// few kilobytes costs the cpu the copy in and an interrupt per chunk.
+//
+// The ring is single producer / single consumer (see ps_ring.h): the producer
+// is the task that owns stdio, the consumer the uart and DMA interrupts.
+
+// Queue size in characters, must be a power of two
+#define PS_DUMP_QUEUE_CHARS 4096
+
+// Takes a DMA channel and turns on the PL011 transmit DMA request. Call once
+// the PL011 tx handler is set, from a task before stdio is switched over.
+void ps_dump_init(void);
+
+// Queues text to be sent by DMA. Waits up to PS_OUTPUT_WRITE_TIMEOUT_MS for
+// room with PS_OUTPUT_WRITE_BLOCK, otherwise drops what does not fit.
+// PS_OUTPUT_WRITE_OVERWRITE is refused at build time. Returns the characters
+// queued.
+size_t ps_dump_write(const char *text, size_t length);
+
+void ps_dump_print_stats(void);
+
+void ps_dump_reset_stats(void);
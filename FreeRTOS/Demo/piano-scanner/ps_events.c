@@ -0,0 +1,79 @@
+#include <string.h>
+#include "piano_scanner.h"
+#include "ps_events.h"
+#include "ps_ring.h"
+
+#if !PS_RING_IS_POWER_OF_TWO(PS_EVENTS_QUEUE_BYTES)
+#error "PS_EVENTS_QUEUE_BYTES must be a power of two"
+#endif
+
+static uint8_t queue_storage[PS_EVENTS_QUEUE_BYTES];
+static ps_ring_t queue;
+
+static ps_key_event_handler_t handlers[PS_EVENTS_MAX_HANDLERS];
+static int handler_count;
+
+static volatile uint32_t dropped;
+
+void ps_events_init(void)
+{
+    ps_ring_init(&queue, queue_storage, sizeof(queue_storage));
+    memset(handlers, 0, sizeof(handlers));
+    handler_count = 0;
+    dropped = 0;
+}
+
+bool ps_events_add_handler(ps_key_event_handler_t handler)
+{
+    if (handler_count == PS_EVENTS_MAX_HANDLERS)
+    {
+        return false;
+    }
+    handlers[handler_count++] = handler;
+    return true;
+}
+
+bool ps_events_push(int key, ps_key_edge_t edge, uint32_t time, uint32_t duration)
+{
+    ps_key_event_t event;
+    event.time = time;
+    event.duration = duration;
+    event.key = (uint8_t)key;
+    event.edge = (uint8_t)edge;
+    if (!ps_ring_push(&queue, &event, sizeof(event)))
+    {
+        dropped++;
+        return false;
+    }
+    return true;
+}
+
+uint32_t ps_events_dispatch(void)
+{
+    uint32_t count = 0;
+    ps_key_event_t event;
+    while (ps_ring_pop(&queue, &event, sizeof(event)))
+    {
+        for (int h = 0; h < handler_count; h++)
+        {
+            handlers[h](&event);
+        }
+        count++;
+    }
+    return count;
+}
+
+bool ps_events_pending(void)
+{
+    return ps_ring_used(&queue) != 0;
+}
+
+uint32_t ps_events_dropped(void)
+{
+    return dropped;
+}
+
+void ps_events_reset_stats(void)
+{
+    dropped = 0;
+}
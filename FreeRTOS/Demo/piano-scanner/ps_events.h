@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "piano_scanner.h"
+
+// Key events. The key state machine only works out what each key did and
+// queues a small fixed size record for it, so the producer task's time per
+// frame does not grow with the number of notes played. Velocity mapping, midi
+// encoding, statistics and logging are done by the handlers below, called from
+// a lower priority task through ps_events_dispatch().
+//
+// The queue is a single producer / single consumer ring (see ps_ring.h): the
+// producer task pushes and the dispatching task pops.
+
+typedef enum
+{
+    PS_KEY_PRESS,           // make switch closed, key on its way down
+    PS_KEY_STRIKE,          // break switch closed, duration is the make to break time
+    PS_KEY_RELEASE,         // make switch opened after a strike, duration is the break to make
+                            // time, 0 when both opened within one pass
+    PS_KEY_NO_HIT,          // make switch opened without the key reaching the break switch
+    PS_KEY_END_BEFORE_START // break switch closed with the make switch open, a wiring or scan fault
+} ps_key_edge_t;
+
+typedef struct
+{
+    uint32_t time;     // us timer when the edge was sampled
+    uint32_t duration; // PS_KEY_STRIKE and PS_KEY_RELEASE only
+    uint8_t key;
+    uint8_t edge;      // ps_key_edge_t
+} ps_key_event_t;
+
+_Static_assert(sizeof(ps_key_event_t) == 12, "key events should be 12 bytes");
+
+// Queue size in bytes, must be a power of two. Room for 341 events, several
+// passes of every key changing state.
+#define PS_EVENTS_QUEUE_BYTES 4096
+
+#define PS_EVENTS_MAX_HANDLERS 4
+
+typedef void (*ps_key_event_handler_t)(const ps_key_event_t *event);
+
+// Empties the queue and removes all handlers
+void ps_events_init(void);
+
+// Handlers are called in the order they were added, from the dispatching task
+bool ps_events_add_handler(ps_key_event_handler_t handler);
+
+// Producer side. Never blocks: returns false and counts a drop if the queue is
+// full. ps_process_frame() keeps the key in its old state and pushes the event
+// again next pass, so a drop delays a key's event rather than losing it.
+bool ps_events_push(int key, ps_key_edge_t edge, uint32_t time, uint32_t duration);
+
+// Consumer side. Hands every queued event to the handlers, returns how many.
+uint32_t ps_events_dispatch(void);
+
+bool ps_events_pending(void);
+
+uint32_t ps_events_dropped(void);
+
+void ps_events_reset_stats(void);
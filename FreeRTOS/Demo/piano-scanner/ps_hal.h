@@ -0,0 +1,26 @@
+#pragma once
+
+// Hardware abstraction for the piano scanner. The scan engine, key state machine
+// and midi output only reach the hardware through these macros:
+//
+//   GPIO_SET_PINS(mask)               drive the shift register control lines in
+//   GPIO_CLR_PINS(mask)               mask (GPIO 0-31) high or low in one store
+//   SHIFT_REG_WRITE(outputs)          set all the shift register outputs at once (PS_SHIFT_REG_SPI)
+//   GPIO_READ_LEVELS(reg)             read gpio level register 0 (GPIO 0-31) or 1 (32-53)
+//   GPIO_READ_EVENTS(reg)             the gpios of a register that have risen since the last clear
+//   GPIO_CLEAR_EVENTS(reg, mask)
+//   READ_U32BIT_US_TIME()             free running 32 bit microsecond counter
+//   RUN_LED_ON() / RUN_LED_OFF()
+//   UART_TX_START()                   new data for ps_output_next_byte()
+//   SUSPEND_TASKS() / RESUME_TASKS()  keep other tasks off a short copy
+//   ENTER_CRITICAL() / EXIT_CRITICAL() keep the interrupts off as well
+//   TASK_DELAY_MS(ms)                 let other tasks and the interrupts run
+//
+// The Raspberry Pi backend maps them onto the bcm2835 drivers. Building with
+// PS_HAL_HOST selects the Linux simulator in host/ instead.
+
+#ifdef PS_HAL_HOST
+#include "host/ps_hal_host.h"
+#else
+#include "ps_hal_bcm2835.h"
+#endif
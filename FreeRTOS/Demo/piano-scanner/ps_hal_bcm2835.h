@@ -0,0 +1,28 @@
+#pragma once
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include "drivers/bcm2835.h"
+#include "bcm2835_miniuart.h"
+#include "bcm2835_pl011.h"
+#include "bcm2835_spi_shiftreg.h"
+
+#define GPIO_SET_PINS(mask) bcm2835_gpio_set_multi(mask)
+#define GPIO_CLR_PINS(mask) bcm2835_gpio_clr_multi(mask)
+#define SHIFT_REG_WRITE(outputs) bcm2835_spi_shiftreg_write(outputs, PS_SHIFT_REG_OUTPUTS / 8)
+#define GPIO_READ_LEVELS(reg) bcm2835_peri_read(bcm2835_gpio + BCM2835_GPLEV0/4 + (reg))
+#define GPIO_READ_EVENTS(reg) bcm2835_peri_read(bcm2835_gpio + BCM2835_GPEDS0/4 + (reg))
+#define GPIO_CLEAR_EVENTS(reg, mask) bcm2835_peri_write(bcm2835_gpio + BCM2835_GPEDS0/4 + (reg), mask)
+#define READ_U32BIT_US_TIME() 	bcm2835_peri_read(bcm2835_st + BCM2835_ST_CLO/4)
+#define RUN_LED_ON() bcm2835_gpio_set(LED_PIN)
+#define RUN_LED_OFF() bcm2835_gpio_clr(LED_PIN)
+#if PS_MIDI_UART_PL011
+#define UART_TX_START() bcm2835_pl011_start_tx()
+#else
+#define UART_TX_START() bcm2835_miniuart_enableTXIRQ(true)
+#endif
+#define SUSPEND_TASKS() vTaskSuspendAll()
+#define RESUME_TASKS() xTaskResumeAll()
+#define ENTER_CRITICAL() taskENTER_CRITICAL()
+#define EXIT_CRITICAL() taskEXIT_CRITICAL()
+#define TASK_DELAY_MS(ms) vTaskDelay((ms) / portTICK_PERIOD_MS)
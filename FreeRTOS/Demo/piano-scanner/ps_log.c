@@ -0,0 +1,66 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "piano_scanner.h"
+#include "ps_log.h"
+#include "ps_ring.h"
+#include "ps_output.h"
+
+typedef struct
+{
+    const char *format;
+    uintptr_t args[PS_LOG_MAX_ARGS];
+} ps_log_record_t;
+
+#if !PS_RING_IS_POWER_OF_TWO(PS_LOG_QUEUE_BYTES)
+#error "PS_LOG_QUEUE_BYTES must be a power of two"
+#endif
+
+static uint8_t storage[PS_LOG_QUEUE_BYTES];
+static ps_ring_t queue;
+static volatile uint32_t dropped;
+
+void ps_log_init(void)
+{
+    ps_ring_init(&queue, storage, sizeof(storage));
+    dropped = 0;
+}
+
+bool ps_log_write(const char *format, const uintptr_t args[PS_LOG_MAX_ARGS])
+{
+    ps_log_record_t record;
+    record.format = format;
+    memcpy(record.args, args, sizeof(record.args));
+    if (!ps_ring_push(&queue, &record, sizeof(record)))
+    {
+        dropped++;
+        return false;
+    }
+    return true;
+}
+
+uint32_t ps_log_flush(void)
+{
+    uint32_t lines = 0;
+    ps_log_record_t record;
+    while (ps_output_free(PS_OUTPUT_DIAGNOSTIC) >= PS_LOG_LINE_CHARS && ps_ring_pop(&queue, &record, sizeof(record)))
+    {
+        // every argument is passed whether the format uses it or not, the
+        // ones it does not use are ignored
+        ps_output_printf(record.format, record.args[0], record.args[1], record.args[2],
+                         record.args[3], record.args[4], record.args[5]);
+        lines++;
+    }
+    return lines;
+}
+
+uint32_t ps_log_dropped(void)
+{
+    return dropped;
+}
+
+void ps_log_reset_stats(void)
+{
+    dropped = 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "piano_scanner.h"
+
+// Deferred logging. PS_LOG_FMT (piano_scanner.h) does no formatting: it copies
+// the format string's address and up to PS_LOG_MAX_ARGS arguments, each
+// widened to a uintptr_t, into a ring. ps_log_flush() formats them later at low
+// priority (the command task on the Pi) and queues the text on the diagnostic
+// output class, so a log line costs the logging task a few stores however slow
+// the uart is, and logging can stay on while playing.
+//
+// As the text is made later the format has to be a string literal, %s
+// arguments have to be strings that are never freed or changed, and arguments
+// can be at most pointer sized.
+//
+// The ring is single producer / single consumer (see ps_ring.h). Once the
+// scheduler is running only the key event task logs; before that ps_init()
+// may. No other task and no interrupt handler may log. The consumer is
+// whichever task calls ps_log_flush().
+
+// Ring size in bytes, must be a power of two. Room for 73 lines on the Pi.
+#define PS_LOG_QUEUE_BYTES 2048
+
+// Longest line ps_log_flush() formats, longer ones are cut short
+#define PS_LOG_LINE_CHARS 96
+
+void ps_log_init(void);
+
+// Producer side, through PS_LOG_FMT. Never blocks: returns false and counts a
+// drop if the ring is full.
+bool ps_log_write(const char *format, const uintptr_t args[PS_LOG_MAX_ARGS]);
+
+// Consumer side. Formats queued lines onto the diagnostic output class while
+// it has room for a whole line, returns how many.
+uint32_t ps_log_flush(void);
+
+uint32_t ps_log_dropped(void);
+
+void ps_log_reset_stats(void);
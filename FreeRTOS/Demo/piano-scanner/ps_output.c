@@ -0,0 +1,361 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "piano_scanner.h"
+#include "ps_output.h"
+#include "ps_ring.h"
+#include "ps_stats.h"
+
+typedef struct
+{
+    uint32_t time; // when it was queued
+    uint8_t length;
+    uint8_t data[PS_OUTPUT_RECORD_DATA];
+} ps_output_record_t;
+
+_Static_assert(sizeof(ps_output_record_t) == 16, "output records should be 16 bytes");
+
+#if !PS_RING_IS_POWER_OF_TWO(PS_OUTPUT_NOTE_ON_RECORDS) || !PS_RING_IS_POWER_OF_TWO(PS_OUTPUT_NOTE_OFF_RECORDS) \
+    || !PS_RING_IS_POWER_OF_TWO(PS_OUTPUT_CONTROLLER_RECORDS) || !PS_RING_IS_POWER_OF_TWO(PS_OUTPUT_DIAGNOSTIC_RECORDS)
+#error "PS_OUTPUT_*_RECORDS must be powers of two"
+#endif
+
+typedef struct
+{
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t latency_max;
+    uint32_t latency[PS_OUTPUT_LATENCY_BINS];
+} ps_output_stats_t;
+
+static const char *const class_names[PS_OUTPUT_CLASSES] = { "note on", "note off", "controller", "diagnostic" };
+
+// 0 for note-on: it is never held back for another class
+static const uint32_t max_wait[PS_OUTPUT_CLASSES] =
+{
+    0, PS_OUTPUT_NOTE_OFF_MAX_WAIT_US, PS_OUTPUT_CONTROLLER_MAX_WAIT_US, PS_OUTPUT_DIAGNOSTIC_MAX_WAIT_US
+};
+
+static uint8_t note_on_storage[PS_OUTPUT_NOTE_ON_RECORDS * sizeof(ps_output_record_t)];
+static uint8_t note_off_storage[PS_OUTPUT_NOTE_OFF_RECORDS * sizeof(ps_output_record_t)];
+static uint8_t controller_storage[PS_OUTPUT_CONTROLLER_RECORDS * sizeof(ps_output_record_t)];
+static uint8_t diagnostic_storage[PS_OUTPUT_DIAGNOSTIC_RECORDS * sizeof(ps_output_record_t)];
+static ps_ring_t queues[PS_OUTPUT_CLASSES];
+
+// The note-on and note-off of a note have to reach the receiver in the order
+// the key played them even though they sit in different queues. Each key
+// alternates on, off, on... so per note it is enough to count what has been
+// sent: a note-on can go once every earlier note-on has had its note-off, and a
+// note-off once its note-on has gone. Note-offs dropped for want of room count
+// as gone; a dropped note-on takes its note-off with it, and a note-off dropped
+// while its note-on is still queued takes the note-on with it.
+// The sent counts are written by the tx interrupt, the rest by the key event task.
+static volatile uint8_t ons_sent[128];
+static volatile uint8_t offs_sent[128];
+static volatile uint8_t offs_lost[128];
+static bool on_dropped[128];
+
+// Tx interrupt state: the record on the line and the next byte of it
+static ps_output_record_t current;
+static uint32_t current_offset;
+static int current_output_class;
+static volatile uint8_t running_status;
+
+static ps_output_bulk_handler bulk_handler;
+static volatile bool bulk_active;
+
+static ps_output_stats_t stats[PS_OUTPUT_CLASSES];
+
+// ps_output_write() counts, in bytes but for overwritten which is records
+static struct
+{
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t wait_ms;
+    uint32_t overwritten;
+} write_stats;
+
+// The note a note-on or note-off record is for. The note message is always the
+// last in its record, after any prefix such as a high resolution velocity.
+static uint8_t ps_output_note(const uint8_t *data, uint32_t length)
+{
+    return data[length - 2] & 0x7F;
+}
+
+void ps_output_init(void)
+{
+    ps_ring_init(&queues[PS_OUTPUT_NOTE_ON], note_on_storage, sizeof(note_on_storage));
+    ps_ring_init(&queues[PS_OUTPUT_NOTE_OFF], note_off_storage, sizeof(note_off_storage));
+    ps_ring_init(&queues[PS_OUTPUT_CONTROLLER], controller_storage, sizeof(controller_storage));
+    ps_ring_init(&queues[PS_OUTPUT_DIAGNOSTIC], diagnostic_storage, sizeof(diagnostic_storage));
+    memset((void *)ons_sent, 0, sizeof(ons_sent));
+    memset((void *)offs_sent, 0, sizeof(offs_sent));
+    memset((void *)offs_lost, 0, sizeof(offs_lost));
+    memset(on_dropped, 0, sizeof(on_dropped));
+    current.length = 0;
+    current_offset = 0;
+    running_status = 0;
+    bulk_handler = NULL;
+    bulk_active = false;
+    ps_output_reset_stats();
+}
+
+bool ps_output_send(ps_output_class_t output_class, const uint8_t *data, size_t length)
+{
+    uint8_t note = output_class <= PS_OUTPUT_NOTE_OFF ? ps_output_note(data, length) : 0;
+    if (output_class == PS_OUTPUT_NOTE_OFF && on_dropped[note])
+    {
+        on_dropped[note] = false;
+        return true;
+    }
+
+    ps_output_record_t record;
+    record.time = READ_U32BIT_US_TIME();
+    record.length = length;
+    memcpy(record.data, data, length);
+    if (!ps_ring_push(&queues[output_class], &record, sizeof(record)))
+    {
+        if (output_class == PS_OUTPUT_NOTE_ON)
+        {
+            on_dropped[note] = true;
+        }
+        else if (output_class == PS_OUTPUT_NOTE_OFF)
+        {
+            offs_lost[note]++;
+        }
+        stats[output_class].dropped++;
+        if (output_class != PS_OUTPUT_DIAGNOSTIC)
+        {
+            ps_stats_midi_dropped(length);
+        }
+        return false;
+    }
+    UART_TX_START();
+    return true;
+}
+
+void ps_output_printf(const char *format, ...)
+{
+    char text[96];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    PS_SATURATE((int)sizeof(text) - 1, 0, length);
+
+    for (int sent = 0; sent < length; sent += PS_OUTPUT_RECORD_DATA)
+    {
+        int chunk = length - sent;
+        PS_SATURATE(PS_OUTPUT_RECORD_DATA, 0, chunk);
+        if (!ps_output_send(PS_OUTPUT_DIAGNOSTIC, (const uint8_t *)text + sent, chunk))
+        {
+            break;
+        }
+    }
+}
+
+size_t ps_output_write(const char *text, size_t length)
+{
+    ps_ring_t *queue = &queues[PS_OUTPUT_DIAGNOSTIC];
+    size_t queued = 0;
+    uint32_t waited_ms = 0;
+    while (queued < length)
+    {
+        if (ps_ring_free(queue) < sizeof(ps_output_record_t))
+        {
+#if PS_OUTPUT_WRITE_POLICY == PS_OUTPUT_WRITE_OVERWRITE
+            // Only the consumer may move the tail, so the tx interrupt is kept
+            // off while this task stands in for it
+            ENTER_CRITICAL();
+            if (ps_ring_used(queue) >= sizeof(ps_output_record_t))
+            {
+                ps_ring_skip(queue, sizeof(ps_output_record_t));
+                write_stats.overwritten++;
+            }
+            EXIT_CRITICAL();
+            continue;
+#elif PS_OUTPUT_WRITE_POLICY == PS_OUTPUT_WRITE_BLOCK
+            if (waited_ms < PS_OUTPUT_WRITE_TIMEOUT_MS)
+            {
+                TASK_DELAY_MS(1);
+                waited_ms++;
+                continue;
+            }
+            break;
+#else
+            break;
+#endif
+        }
+        size_t chunk = length - queued;
+        PS_SATURATE(PS_OUTPUT_RECORD_DATA, 0, chunk);
+        ps_output_send(PS_OUTPUT_DIAGNOSTIC, (const uint8_t *)text + queued, chunk);
+        queued += chunk;
+    }
+    write_stats.written += queued;
+    write_stats.dropped += length - queued;
+    write_stats.wait_ms += waited_ms;
+    return queued;
+}
+
+uint32_t ps_output_free(ps_output_class_t output_class)
+{
+    return ps_ring_free(&queues[output_class]) / sizeof(ps_output_record_t) * PS_OUTPUT_RECORD_DATA;
+}
+
+// Whether the oldest record of a class may be sent now, and when it was queued
+static bool ps_output_head_ready(int output_class, uint32_t *queued_time)
+{
+    ps_output_record_t head;
+    while (ps_ring_peek(&queues[output_class], &head, sizeof(head)))
+    {
+        *queued_time = head.time;
+        if (output_class > PS_OUTPUT_NOTE_OFF)
+        {
+            return true;
+        }
+
+        // note-ons sent that have not had their note-off, negative when the
+        // note-off of the note-on at the head has already been dropped
+        uint8_t note = ps_output_note(head.data, head.length);
+        int8_t sounding = (int8_t)(ons_sent[note] - offs_sent[note] - offs_lost[note]);
+        if (output_class == PS_OUTPUT_NOTE_OFF)
+        {
+            return sounding > 0;    // its note-on has to go first
+        }
+        if (sounding >= 0)
+        {
+            return sounding == 0;   // the last note-off for this note has to go first
+        }
+        ps_ring_skip(&queues[output_class], sizeof(head));
+        ons_sent[note]++;
+    }
+    return false;
+}
+
+// The class to send from next, or -1 when there is nothing to send
+static int ps_output_select(void)
+{
+    uint32_t now = READ_U32BIT_US_TIME();
+    uint32_t queued_time;
+
+    // bounded latency: the highest priority class that is overdue goes first
+    for (int c = PS_OUTPUT_NOTE_OFF; c < PS_OUTPUT_CLASSES; c++)
+    {
+        if (ps_output_head_ready(c, &queued_time) && now - queued_time > max_wait[c])
+        {
+            return c;
+        }
+    }
+
+    for (int c = PS_OUTPUT_NOTE_ON; c < PS_OUTPUT_CLASSES; c++)
+    {
+        if (ps_output_head_ready(c, &queued_time))
+        {
+            return c;
+        }
+    }
+    return -1;
+}
+
+// Runs in interrupt context
+bool ps_output_next_byte(char *c)
+{
+    if (bulk_active)
+    {
+        return false;
+    }
+    if (current_offset >= current.length)
+    {
+        int output_class = ps_output_select();
+        if (output_class < 0 || !ps_ring_pop(&queues[output_class], &current, sizeof(current)))
+        {
+            current.length = 0;
+            current_offset = 0;
+            if (bulk_handler && bulk_handler())
+            {
+                bulk_active = true;
+                running_status = 0;
+            }
+            return false;
+        }
+        current_output_class = output_class;
+
+        uint32_t latency = READ_U32BIT_US_TIME() - current.time;
+        int bin = latency ? 32 - __builtin_clz(latency) : 0;
+        PS_SATURATE(PS_OUTPUT_LATENCY_BINS - 1, 0, bin);
+        ps_output_stats_t *s = &stats[output_class];
+        s->sent++;
+        s->latency[bin]++;
+        if (latency > s->latency_max) s->latency_max = latency;
+
+        current_offset = 0;
+        if (output_class == PS_OUTPUT_DIAGNOSTIC)
+        {
+            running_status = 0;
+        }
+        else if (output_class == PS_OUTPUT_NOTE_ON)
+        {
+            ons_sent[ps_output_note(current.data, current.length)]++;
+        }
+        else if (output_class == PS_OUTPUT_NOTE_OFF)
+        {
+            offs_sent[ps_output_note(current.data, current.length)]++;
+        }
+    }
+
+    uint8_t byte = current.data[current_offset++];
+    if (current_output_class != PS_OUTPUT_DIAGNOSTIC && byte >= 0x80)
+    {
+        // a record can hold more than one message: channel messages can share
+        // a status byte, anything else cancels it
+        if (PS_MIDI_RUNNING_STATUS && byte == running_status)
+        {
+            byte = current.data[current_offset++];
+        }
+        else
+        {
+            running_status = byte < 0xF0 ? byte : 0;
+        }
+    }
+    *c = byte;
+    return true;
+}
+
+void ps_output_set_bulk_handler(ps_output_bulk_handler handler)
+{
+    bulk_handler = handler;
+}
+
+// Runs in interrupt context
+void ps_output_bulk_done(void)
+{
+    bulk_active = false;
+    UART_TX_START();
+}
+
+void ps_output_reset_stats(void)
+{
+    memset(stats, 0, sizeof(stats));
+    memset(&write_stats, 0, sizeof(write_stats));
+}
+
+void ps_output_dump(void)
+{
+    // the counts are updated by the interrupt while this prints, near enough
+    for (int c = 0; c < PS_OUTPUT_CLASSES; c++)
+    {
+        ps_output_stats_t *s = &stats[c];
+        printf("Output %s: sent:%" PRIu32 " dropped:%" PRIu32 " queued max:%" PRIu32 "us\n\r",
+               class_names[c], s->sent, s->dropped, s->latency_max);
+        for (int bin = 0; bin < PS_OUTPUT_LATENCY_BINS; bin++)
+        {
+            if (s->latency[bin])
+            {
+                printf("  <%6luus: %" PRIu32 "\n\r", 1ul << bin, s->latency[bin]);
+            }
+        }
+    }
+    printf("Output stdio: written:%" PRIu32 " dropped:%" PRIu32 " waited:%" PRIu32 "ms overwritten:%" PRIu32 "\n\r",
+           write_stats.written, write_stats.dropped, write_stats.wait_ms, write_stats.overwritten);
+}
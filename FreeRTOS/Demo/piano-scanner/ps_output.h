@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "piano_scanner.h"
+
+// Prioritised uart output. Everything sent on the midi uart is queued in one of
+// four classes, highest priority first:
+//
+//   PS_OUTPUT_NOTE_ON     always next unless a lower class is overdue
+//   PS_OUTPUT_NOTE_OFF    served within PS_OUTPUT_NOTE_OFF_MAX_WAIT_US
+//   PS_OUTPUT_CONTROLLER  served within PS_OUTPUT_CONTROLLER_MAX_WAIT_US
+//   PS_OUTPUT_DIAGNOSTIC  log text, served within PS_OUTPUT_DIAGNOSTIC_MAX_WAIT_US
+//
+// so a burst of releases or a debug print cannot hold up the next strike for
+// longer than the message already on the line. Once the oldest message of a
+// lower class has waited past its bound it goes next. The note-on and note-off
+// of a note are never reordered though: a note-on that overtook the note-off
+// before it would be ended by it, and a note-off that overtook its note-on
+// would leave the note stuck.
+//
+// Each class is a single producer / single consumer ring of fixed 16 byte
+// records (see ps_ring.h) written by the key event task, or for diagnostic text
+// the task flushing the log (ps_log.h), and drained one byte at a time by the
+// uart tx interrupt through ps_output_next_byte(). A record is
+// always sent whole, so a record can carry a message together with its prefix
+// (a note record's note message comes last). Running status is applied as
+// records leave, so it stays right whichever order they go in; diagnostic text
+// breaks it.
+
+typedef enum
+{
+    PS_OUTPUT_NOTE_ON,
+    PS_OUTPUT_NOTE_OFF,
+    PS_OUTPUT_CONTROLLER,
+    PS_OUTPUT_DIAGNOSTIC,
+    PS_OUTPUT_CLASSES
+} ps_output_class_t;
+
+// Queue depths in records, each must be a power of two
+#define PS_OUTPUT_NOTE_ON_RECORDS 64
+#define PS_OUTPUT_NOTE_OFF_RECORDS 64
+#define PS_OUTPUT_CONTROLLER_RECORDS 16
+#define PS_OUTPUT_DIAGNOSTIC_RECORDS 64
+
+#define PS_OUTPUT_NOTE_OFF_MAX_WAIT_US 2000
+#define PS_OUTPUT_CONTROLLER_MAX_WAIT_US 5000
+#define PS_OUTPUT_DIAGNOSTIC_MAX_WAIT_US 20000
+
+// Most bytes in one record
+#define PS_OUTPUT_RECORD_DATA 11
+
+// Queue latency histogram, bin n counts waits of 2^(n-1) to 2^n - 1 us
+#define PS_OUTPUT_LATENCY_BINS 16
+
+void ps_output_init(void);
+
+// Queues one message, or a message and its prefix, as a single record. Never
+// blocks: returns false and counts a drop if the class is full. Key event task
+// only.
+bool ps_output_send(ps_output_class_t output_class, const uint8_t *data, size_t length);
+
+// printf to the diagnostic class, split over as many records as it needs
+void ps_output_printf(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+
+// What ps_output_write() does when the diagnostic class is full
+#define PS_OUTPUT_WRITE_DROP 0      // drop the text that does not fit
+#define PS_OUTPUT_WRITE_BLOCK 1     // wait for the uart to make room, for up to
+                                    // PS_OUTPUT_WRITE_TIMEOUT_MS a write, then drop
+#define PS_OUTPUT_WRITE_OVERWRITE 2 // throw away the oldest queued text instead
+#ifndef PS_OUTPUT_WRITE_POLICY
+#define PS_OUTPUT_WRITE_POLICY PS_OUTPUT_WRITE_BLOCK
+#endif
+#define PS_OUTPUT_WRITE_TIMEOUT_MS 100
+
+// stdio text (the libc _write hook, see ps_tasks.c) to the diagnostic class,
+// split over as many records as it needs. Returns the bytes queued. The
+// diagnostic class has one producer, so stdio and the log flush have to be in
+// the same task.
+size_t ps_output_write(const char *text, size_t length);
+
+// Bytes a class can still take, counting whole records
+uint32_t ps_output_free(ps_output_class_t output_class);
+
+// Uart tx handler: the next byte to send, false when everything has gone
+bool ps_output_next_byte(char *c);
+
+// Bulk transmission outside the queues, such as DMA (ps_dump.h). The handler
+// is called from the uart tx handler whenever every class is empty. It returns
+// true if it has started a transfer, after which no bytes are given out until
+// ps_output_bulk_done(), so a message waits for at most one transfer.
+typedef bool (*ps_output_bulk_handler)(void);
+
+void ps_output_set_bulk_handler(ps_output_bulk_handler handler);
+
+// Hands the uart back once a bulk transfer has finished, from interrupt context
+void ps_output_bulk_done(void);
+
+void ps_output_reset_stats(void);
+void ps_output_dump(void);
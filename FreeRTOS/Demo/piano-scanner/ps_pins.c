@@ -0,0 +1,95 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "piano_scanner.h"
+#include "ps_pins.h"
+
+const uint8_t ps_key_input_gpios[PS_NUMBER_OF_KEYS_PER_BANK] = { PS_KEY_INPUT_GPIOS };
+
+_Static_assert(sizeof((uint8_t[]){ PS_KEY_INPUT_GPIOS }) == PS_NUMBER_OF_KEYS_PER_BANK,
+               "PS_KEY_INPUT_GPIOS needs one gpio per key in a bank");
+
+// bank bits |= ((register >> shift) & mask) << bit
+typedef struct
+{
+    uint8_t reg;
+    uint8_t shift;
+    uint8_t bit;
+    uint32_t mask;
+} ps_pins_run_t;
+
+static ps_pins_run_t runs[PS_PINS_MAX_RUNS];
+static int run_count;
+static uint32_t register_mask[2];
+
+void ps_pins_init(void)
+{
+    run_count = 0;
+    register_mask[0] = 0;
+    register_mask[1] = 0;
+    for (int line = 0; line < PS_NUMBER_OF_KEYS_PER_BANK; line++)
+    {
+        uint8_t gpio = ps_key_input_gpios[line];
+        register_mask[gpio / 32] |= 1u << (gpio % 32);
+
+        // the gpio after the last one in the same register extends its run
+        if (run_count > 0)
+        {
+            ps_pins_run_t *last = &runs[run_count - 1];
+            uint32_t length = 32 - __builtin_clz(last->mask);
+            if (gpio / 32 == last->reg && gpio % 32 == last->shift + length)
+            {
+                last->mask = (last->mask << 1) | 1;
+                continue;
+            }
+        }
+        ps_pins_run_t *run = &runs[run_count++];
+        run->reg = gpio / 32;
+        run->shift = gpio % 32;
+        run->bit = line;
+        run->mask = 1;
+    }
+}
+
+// Runs in interrupt context
+static ps_bank_bits_t ps_pins_gather(uint32_t reg0, uint32_t reg1)
+{
+    uint32_t bits = 0;
+    for (int r = 0; r < run_count; r++)
+    {
+        const ps_pins_run_t *run = &runs[r];
+        bits |= (((run->reg ? reg1 : reg0) >> run->shift) & run->mask) << run->bit;
+    }
+    return (ps_bank_bits_t)bits;
+}
+
+ps_bank_bits_t ps_pins_read_bank(void)
+{
+    return ps_pins_gather(register_mask[0] ? GPIO_READ_LEVELS(0) : 0, register_mask[1] ? GPIO_READ_LEVELS(1) : 0);
+}
+
+ps_bank_bits_t ps_pins_read_bank_edges(void)
+{
+    return ps_pins_gather(register_mask[0] ? GPIO_READ_EVENTS(0) : 0, register_mask[1] ? GPIO_READ_EVENTS(1) : 0);
+}
+
+void ps_pins_clear_bank_edges(void)
+{
+    if (register_mask[0])
+    {
+        GPIO_CLEAR_EVENTS(0, register_mask[0]);
+    }
+    if (register_mask[1])
+    {
+        GPIO_CLEAR_EVENTS(1, register_mask[1]);
+    }
+}
+
+uint32_t ps_pins_register_mask(int reg)
+{
+    return register_mask[reg];
+}
+
+int ps_pins_runs(void)
+{
+    return run_count;
+}
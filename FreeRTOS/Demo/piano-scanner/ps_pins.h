@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "piano_scanner.h"
+
+// Key input pin map. The key input lines can be wired to any gpios listed in
+// PS_KEY_INPUT_GPIOS, across both GPLEV0 and GPLEV1. ps_pins_init() splits the
+// list into runs of consecutive gpios in the same register that land on
+// consecutive bank bits, so gathering a bank word costs one shift and mask per
+// run and one register read per register used, rather than a test per key.
+
+// Most runs a pin map can have, one per key when no two gpios are consecutive
+#define PS_PINS_MAX_RUNS PS_NUMBER_OF_KEYS_PER_BANK
+
+extern const uint8_t ps_key_input_gpios[PS_NUMBER_OF_KEYS_PER_BANK];
+
+// Builds the run table, before the scan starts
+void ps_pins_init(void);
+
+// The bank word for the key inputs as they read now, and for the inputs with a
+// rising edge latched since the last ps_pins_clear_bank_edges()
+ps_bank_bits_t ps_pins_read_bank(void);
+ps_bank_bits_t ps_pins_read_bank_edges(void);
+void ps_pins_clear_bank_edges(void);
+
+// Bits of the key inputs in the gpio registers of a bank (0 for GPxxx0, 1 for GPxxx1)
+uint32_t ps_pins_register_mask(int reg);
+
+// Number of runs the pin map was split into
+int ps_pins_runs(void);
@@ -0,0 +1,110 @@
+#include <string.h>
+#include "ps_ring.h"
+
+void ps_ring_init(ps_ring_t *ring, uint8_t *storage, uint32_t size)
+{
+    ring->data = storage;
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+uint32_t ps_ring_used(const ps_ring_t *ring)
+{
+    return ring->head - ring->tail;
+}
+
+uint32_t ps_ring_free(const ps_ring_t *ring)
+{
+    return ring->mask + 1 - (ring->head - ring->tail);
+}
+
+// Copies out of the ring handling the wrap at the end of the storage
+static void ps_ring_copy_out(const ps_ring_t *ring, uint32_t index, uint8_t *dst, uint32_t len)
+{
+    uint32_t offset = index & ring->mask;
+    uint32_t first = ring->mask + 1 - offset;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(dst, &ring->data[offset], first);
+    memcpy(dst + first, ring->data, len - first);
+}
+
+bool ps_ring_push(ps_ring_t *ring, const void *src, uint32_t len)
+{
+    uint32_t head = ring->head;
+    if (ring->mask + 1 - (head - ring->tail) < len)
+    {
+        return false;
+    }
+    uint32_t offset = head & ring->mask;
+    uint32_t first = ring->mask + 1 - offset;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(&ring->data[offset], src, first);
+    memcpy(ring->data, (const uint8_t *)src + first, len - first);
+    // The data must be visible before the consumer can see the new head
+    PS_MEMORY_BARRIER();
+    ring->head = head + len;
+    return true;
+}
+
+bool ps_ring_peek(const ps_ring_t *ring, void *dst, uint32_t len)
+{
+    uint32_t tail = ring->tail;
+    if (ring->head - tail < len)
+    {
+        return false;
+    }
+    // Do not read the data before the head that published it
+    PS_MEMORY_BARRIER();
+    ps_ring_copy_out(ring, tail, dst, len);
+    return true;
+}
+
+bool ps_ring_pop(ps_ring_t *ring, void *dst, uint32_t len)
+{
+    if (!ps_ring_peek(ring, dst, len))
+    {
+        return false;
+    }
+    // The copy must be complete before the producer can reuse the space
+    PS_MEMORY_BARRIER();
+    ring->tail += len;
+    return true;
+}
+
+bool ps_ring_pop_byte(ps_ring_t *ring, uint8_t *byte)
+{
+    uint32_t tail = ring->tail;
+    if (ring->head == tail)
+    {
+        return false;
+    }
+    PS_MEMORY_BARRIER();
+    *byte = ring->data[tail & ring->mask];
+    PS_MEMORY_BARRIER();
+    ring->tail = tail + 1;
+    return true;
+}
+
+uint32_t ps_ring_contiguous(const ps_ring_t *ring, const uint8_t **data)
+{
+    uint32_t tail = ring->tail;
+    uint32_t used = ring->head - tail;
+    uint32_t offset = tail & ring->mask;
+    uint32_t to_end = ring->mask + 1 - offset;
+    PS_MEMORY_BARRIER();
+    *data = &ring->data[offset];
+    return used < to_end ? used : to_end;
+}
+
+void ps_ring_skip(ps_ring_t *ring, uint32_t len)
+{
+    PS_MEMORY_BARRIER();
+    ring->tail += len;
+}
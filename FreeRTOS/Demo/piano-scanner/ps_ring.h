@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Single producer / single consumer lock free ring buffer.
+// The head index is only ever written by the producer and the tail index only by
+// the consumer, so a task can feed an interrupt (or the other way round) without
+// a critical section. Both indices run freely modulo 2^32 and are masked on access,
+// which is why the size must be a power of two.
+typedef struct
+{
+    uint8_t *data;
+    uint32_t mask;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+} ps_ring_t;
+
+#define PS_RING_IS_POWER_OF_TWO(size) ((size) != 0 && ((size) & ((size) - 1)) == 0)
+
+// ARMv6 has no DMB instruction, the equivalent data memory barrier is the CP15 c7, c10, 5
+// operation. Other targets (the host builds) use the compiler's full barrier.
+#if defined(__ARM_ARCH_6__) || defined(__ARM_ARCH_6J__) || defined(__ARM_ARCH_6Z__) || defined(__ARM_ARCH_6ZK__) || defined(__ARM_ARCH_6K__)
+#define PS_MEMORY_BARRIER() __asm volatile ("mcr p15, 0, %0, c7, c10, 5" : : "r" (0) : "memory")
+#else
+#define PS_MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+void ps_ring_init(ps_ring_t *ring, uint8_t *storage, uint32_t size);
+
+uint32_t ps_ring_used(const ps_ring_t *ring);
+
+uint32_t ps_ring_free(const ps_ring_t *ring);
+
+// Producer side. Pushes all len bytes or nothing, so a whole message is never split.
+bool ps_ring_push(ps_ring_t *ring, const void *src, uint32_t len);
+
+// Consumer side. Pops exactly len bytes or nothing.
+bool ps_ring_pop(ps_ring_t *ring, void *dst, uint32_t len);
+
+// Consumer side. Copies len bytes without removing them.
+bool ps_ring_peek(const ps_ring_t *ring, void *dst, uint32_t len);
+
+bool ps_ring_pop_byte(ps_ring_t *ring, uint8_t *byte);
+
+// Consumer side, for handing queued bytes to hardware without copying them.
+// Points data at the oldest byte and returns how many follow it before the
+// end of the storage or the head, whichever is first.
+uint32_t ps_ring_contiguous(const ps_ring_t *ring, const uint8_t **data);
+
+// Consumer side. Removes len bytes once they have been read in place.
+void ps_ring_skip(ps_ring_t *ring, uint32_t len);
@@ -0,0 +1,130 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include "piano_scanner.h"
+#include "ps_scan.h"
+#include "ps_pins.h"
+
+// The scan engine walks a single bit through the shift register from a system
+// timer compare interrupt. Every interrupt samples the half bank that has been
+// energised (and settling) since the previous interrupt, then clocks the shift
+// register on to the next half bank. The scan rate is set by the timer alone,
+// the CPU is free between samples. The shift register is either bit-banged or,
+// with PS_SHIFT_REG_SPI, written whole over SPI0. With PS_SCAN_EDGE_DETECT each sample also
+// includes the rising edges latched since its half bank was energised.
+//
+// Frames are double buffered: the interrupt fills one while the task works on
+// the other. If the task still holds its frame when the next one completes, the
+// new frame is refilled and counted as an overrun.
+//
+// Waking the task and the timer itself are the caller's business (ps_tasks.c on
+// the Pi, the simulator on the host).
+
+static ps_scan_frame_t frames[2];
+static uint32_t fill_frame;
+static uint32_t half_bank;
+static volatile uint32_t ready_frame;
+static volatile bool frame_pending;
+static volatile uint32_t overruns;
+
+void ps_scan_shift_spi_write(uint32_t output)
+{
+    SHIFT_REG_WRITE(1u << output);
+}
+
+// The bit-banged sequences use as few GPSET0/GPCLR0 stores as the 74HC595
+// allows. Lines that change the same way at the same point go in one store, and
+// the latch rises while the clock is still high: a store to the gpio block
+// takes far longer than the 595's clock to latch setup time, so the latch still
+// sees the shifted stage.
+void ps_scan_shift_gpio_advance(void)
+{
+    GPIO_SET_PINS(PS_SHIFT_REG_CLOCK_MASK); // Clock the shift reg
+    GPIO_SET_PINS(PS_SHIFT_REG_LATCH_MASK); // Latch the data out
+    GPIO_CLR_PINS(PS_SHIFT_REG_CLOCK_MASK | PS_SHIFT_REG_LATCH_MASK);
+}
+
+// Reset shift register and clock a 1 to output 0
+static void ps_scan_reset_shift_register(void)
+{
+#if PS_SHIFT_REG_SPI
+    ps_scan_shift_spi_write(0);
+#else
+    GPIO_CLR_PINS(PS_SHIFT_REG_RESET_MASK);
+    GPIO_SET_PINS(PS_SHIFT_REG_RESET_MASK | PS_SHIFT_REG_INPUT_MASK);
+    GPIO_SET_PINS(PS_SHIFT_REG_CLOCK_MASK); // Clock the bit into the shift regs
+    GPIO_SET_PINS(PS_SHIFT_REG_LATCH_MASK); // Latch the data out
+    GPIO_CLR_PINS(PS_SHIFT_REG_CLOCK_MASK | PS_SHIFT_REG_LATCH_MASK | PS_SHIFT_REG_INPUT_MASK);
+#endif
+#if PS_SCAN_EDGE_DETECT
+    ps_pins_clear_bank_edges(); // edges from here on belong to the new half bank
+#endif
+}
+
+// Move the bit on to the output of half_bank
+static void ps_scan_advance_shift_register(void)
+{
+#if PS_SHIFT_REG_SPI
+    ps_scan_shift_spi_write(half_bank);
+#else
+    ps_scan_shift_gpio_advance();
+#endif
+#if PS_SCAN_EDGE_DETECT
+    ps_pins_clear_bank_edges();
+#endif
+}
+
+// Runs in interrupt context once per half bank
+bool ps_scan_tick(void)
+{
+    ps_scan_frame_t *frame = &frames[fill_frame];
+#if PS_SCAN_EDGE_DETECT
+    // contacts that closed and opened again since the half bank was energised
+    ps_bank_bits_t edges = ps_pins_read_bank_edges();
+    frame->bits[half_bank] = ps_pins_read_bank() | edges;
+#else
+    frame->bits[half_bank] = ps_pins_read_bank();
+#endif
+    frame->time[half_bank] = READ_U32BIT_US_TIME();
+
+    if (++half_bank < PS_SCAN_HALF_BANKS)
+    {
+        ps_scan_advance_shift_register();
+        return false;
+    }
+
+    half_bank = 0;
+    ps_scan_reset_shift_register();
+
+    if (frame_pending)
+    {
+        overruns++;
+        return false;
+    }
+    ready_frame = fill_frame;
+    frame_pending = true;
+    fill_frame ^= 1;
+    return true;
+}
+
+void ps_scan_reset(void)
+{
+    fill_frame = 0;
+    half_bank = 0;
+    frame_pending = false;
+    ps_scan_reset_shift_register();
+}
+
+const ps_scan_frame_t *ps_scan_ready_frame(void)
+{
+    return frame_pending ? &frames[ready_frame] : NULL;
+}
+
+void ps_scan_release_frame(void)
+{
+    frame_pending = false;
+}
+
+uint32_t ps_scan_overruns(void)
+{
+    return overruns;
+}
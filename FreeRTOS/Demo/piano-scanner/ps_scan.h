@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "piano_scanner.h"
+
+// Each bank is read twice, once with its start (make) line energised and once
+// with its end (break) line energised. Half bank 2n is the start switches of
+// bank n and half bank 2n+1 its end switches.
+#define PS_SCAN_HALF_BANKS (PS_NUMBER_OF_KEY_BANKS * 2)
+
+// One full pass over the keyboard as sampled by the scan timer interrupt
+typedef struct ps_scan_frame
+{
+    ps_bank_bits_t bits[PS_SCAN_HALF_BANKS];
+    uint32_t time[PS_SCAN_HALF_BANKS];
+} ps_scan_frame_t;
+
+// Resets the shift register so the next tick samples half bank 0
+void ps_scan_reset(void);
+
+// Samples the energised half bank and moves on to the next. Called every
+// PS_SCAN_HALF_BANK_PERIOD_US from the scan timer interrupt. Returns true when
+// it has just completed a frame that is now waiting to be processed.
+bool ps_scan_tick(void);
+
+// The completed frame waiting to be processed, or NULL. The frame stays valid
+// until ps_scan_release_frame() is called.
+const ps_scan_frame_t *ps_scan_ready_frame(void);
+
+void ps_scan_release_frame(void);
+
+// Number of complete frames thrown away because the previous one had not been released
+uint32_t ps_scan_overruns(void);
+
+// The two shift register drives, for ps_bench.c. The scan uses whichever
+// PS_SHIFT_REG_SPI selects. The gpio drive clocks the walking bit on one
+// output, the SPI drive energises the given output alone.
+void ps_scan_shift_gpio_advance(void);
+void ps_scan_shift_spi_write(uint32_t output);
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "piano_scanner.h"
+#include "ps_stats.h"
+#include "ps_scan.h"
+#include "ps_events.h"
+#include "ps_log.h"
+
+typedef struct
+{
+    uint32_t frames;
+    uint32_t last_frame_start;
+    uint32_t period_min;
+    uint32_t period_max;
+    uint64_t period_sum;
+    uint32_t periods;
+    uint32_t jitter[PS_STATS_JITTER_BINS];
+    // from the first sample of a frame until the state machine has processed it
+    uint32_t latency_max;
+    uint32_t process_max;
+    uint64_t process_sum;
+    uint32_t midi_dropped_bytes;
+    uint32_t calibration_saturated;
+    uint32_t key_hits[PS_NUMBER_OF_KEYS];
+    uint32_t key_duration_min[PS_NUMBER_OF_KEYS];
+    uint32_t key_duration_max[PS_NUMBER_OF_KEYS];
+    uint32_t key_duration_last[PS_NUMBER_OF_KEYS];
+} ps_stats_t;
+
+static ps_stats_t stats;
+
+void ps_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.period_min = UINT32_MAX;
+    for (int key = 0; key < PS_NUMBER_OF_KEYS; key++)
+    {
+        stats.key_duration_min[key] = UINT32_MAX;
+    }
+}
+
+void ps_stats_frame(uint32_t frame_start_time, uint32_t process_start_time, uint32_t process_end_time)
+{
+    if (stats.frames++ > 0)
+    {
+        uint32_t period = frame_start_time - stats.last_frame_start;
+        if (period < stats.period_min) stats.period_min = period;
+        if (period > stats.period_max) stats.period_max = period;
+        stats.period_sum += period;
+        stats.periods++;
+
+        int32_t bin = ((int32_t)(period - PS_STATS_NOMINAL_SCAN_PERIOD_US) / PS_STATS_JITTER_BIN_US) + PS_STATS_JITTER_BINS / 2;
+        PS_SATURATE(PS_STATS_JITTER_BINS - 1, 0, bin);
+        stats.jitter[bin]++;
+    }
+    stats.last_frame_start = frame_start_time;
+
+    uint32_t latency = process_end_time - frame_start_time;
+    if (latency > stats.latency_max) stats.latency_max = latency;
+    uint32_t process = process_end_time - process_start_time;
+    if (process > stats.process_max) stats.process_max = process;
+    stats.process_sum += process;
+}
+
+void ps_stats_key_hit(int key, uint32_t duration)
+{
+    stats.key_hits[key]++;
+    stats.key_duration_last[key] = duration;
+    if (duration < stats.key_duration_min[key]) stats.key_duration_min[key] = duration;
+    if (duration > stats.key_duration_max[key]) stats.key_duration_max[key] = duration;
+}
+
+void ps_stats_midi_dropped(uint32_t bytes)
+{
+    stats.midi_dropped_bytes += bytes;
+}
+
+void ps_stats_calibration_saturated(void)
+{
+    stats.calibration_saturated++;
+}
+
+void ps_stats_dump(void)
+{
+    // Print from a copy taken with the other tasks suspended so the producer task
+    // cannot update the numbers half way through
+    static ps_stats_t snapshot;
+    SUSPEND_TASKS();
+    snapshot = stats;
+    RESUME_TASKS();
+
+    printf("Scan frames:%" PRIu32 " overruns:%" PRIu32 " nominal period:%uus\n\r",
+           snapshot.frames, ps_scan_overruns(), PS_STATS_NOMINAL_SCAN_PERIOD_US);
+    if (snapshot.periods > 0)
+    {
+        printf("Scan period min:%" PRIu32 "us max:%" PRIu32 "us mean:%" PRIu32 "us\n\r",
+               snapshot.period_min, snapshot.period_max,
+               (uint32_t)(snapshot.period_sum / snapshot.periods));
+    }
+    if (snapshot.frames > 0)
+    {
+        printf("Frame processing max:%" PRIu32 "us mean:%" PRIu32 "us, sample to processed max:%" PRIu32 "us\n\r",
+               snapshot.process_max, (uint32_t)(snapshot.process_sum / snapshot.frames),
+               snapshot.latency_max);
+    }
+    printf("Scan jitter histogram (%ius bins):\n\r", PS_STATS_JITTER_BIN_US);
+    for (int bin = 0; bin < PS_STATS_JITTER_BINS; bin++)
+    {
+        if (snapshot.jitter[bin])
+        {
+            printf("  %+4ius: %" PRIu32 "\n\r", (bin - PS_STATS_JITTER_BINS / 2) * PS_STATS_JITTER_BIN_US, snapshot.jitter[bin]);
+        }
+    }
+    printf("Key events dropped:%" PRIu32 " MIDI dropped bytes:%" PRIu32 " Log lines dropped:%" PRIu32 "\n\r",
+           ps_events_dropped(), snapshot.midi_dropped_bytes, ps_log_dropped());
+    printf("Calibration scales saturated:%" PRIu32 "\n\r", snapshot.calibration_saturated);
+    printf("Key make to break durations:\n\r");
+    for (int key = 0; key < PS_NUMBER_OF_KEYS; key++)
+    {
+        if (snapshot.key_hits[key])
+        {
+            printf("  key:%i hits:%" PRIu32 " min:%" PRIu32 "us max:%" PRIu32 "us last:%" PRIu32 "us\n\r", key, snapshot.key_hits[key],
+                   snapshot.key_duration_min[key], snapshot.key_duration_max[key], snapshot.key_duration_last[key]);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include "piano_scanner.h"
+
+// Scan timing instrumentation. Everything is collected from the scanner tasks
+// with READ_U32BIT_US_TIME() so the cost is a few subtractions and compares per
+// frame, and dumped as text over the uart on request.
+
+// Nominal time between the starts of two scan frames
+#define PS_STATS_NOMINAL_SCAN_PERIOD_US (PS_NUMBER_OF_KEY_BANKS * 2 * PS_SCAN_HALF_BANK_PERIOD_US)
+
+// Scan jitter (period - nominal period) histogram, centred on zero.
+// The outer bins also collect everything beyond them.
+#define PS_STATS_JITTER_BINS 16
+#define PS_STATS_JITTER_BIN_US 2
+
+// Called once per frame with the time of the frame's first sample and the
+// times the state machine started and finished processing it
+void ps_stats_frame(uint32_t frame_start_time, uint32_t process_start_time, uint32_t process_end_time);
+
+void ps_stats_key_hit(int key, uint32_t duration);
+
+void ps_stats_midi_dropped(uint32_t bytes);
+
+// Called by ps_calibration_stop() for each key whose scale did not fit
+void ps_stats_calibration_saturated(void);
+
+void ps_stats_reset(void);
+
+void ps_stats_dump(void);
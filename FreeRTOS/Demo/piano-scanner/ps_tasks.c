@@ -0,0 +1,280 @@
+#include <FreeRTOS.h>
+#include <task.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "piano_scanner.h"
+#include "ps_scan.h"
+#include "ps_pins.h"
+#include "ps_stats.h"
+#include "ps_output.h"
+#include "ps_events.h"
+#include "ps_velocity.h"
+#include "ps_calibration.h"
+#include "ps_bench.h"
+#include "ps_log.h"
+#include "ps_uart_rx.h"
+#include "ps_dump.h"
+#include "drivers/bcm2835.h"
+#include "bcm2835_miniuart.h"
+#include "bcm2835_pl011.h"
+#include "bcm2835_systimer.h"
+#include "bcm2835_spi_shiftreg.h"
+#include "libc_functions.h"
+
+// FreeRTOS side of the piano scanner: hardware set up, the scan timer interrupt
+// and the tasks. The scanning logic itself lives in piano_scanner.c and
+// ps_scan.c so it can also run in the host simulator.
+
+void ps_producer_task(void *params);
+void ps_event_task(void *params);
+void ps_command_task(void *params);
+
+static TaskHandle_t producer_task;
+static TaskHandle_t event_task;
+
+void ps_init(void)
+{
+    // the consumer is the uart tx interrupt, the text before this means the
+    // first message needs its status byte. The interrupt is hooked up by the
+    // producer task, see ps_start_uart().
+    ps_output_init();
+    ps_log_init();
+    ps_init_key_events();
+
+    PS_LOG_FMT("Init Piano Scanner %i", 4);
+    ps_velocity_init();
+	printf("Velocity profile : %s\n\r", ps_velocity_profile(ps_velocity_selected_profile())->name);
+	printf("80000 : %i\n\r", ps_velocity_map(0, 80000));
+	printf("90000 : %i\n\r", ps_velocity_map(0, 90000));
+	printf("2900 : %i\n\r", ps_velocity_map(0, 2900));
+	printf("1000 : %i\n\r", ps_velocity_map(0, 1000));
+
+    // set up gpio
+    bcm2835_gpio_fsel(PS_SHIFT_REG_RESET_GPIO_NUMBER, BCM2835_GPIO_FSEL_OUTP);
+    bcm2835_gpio_fsel(PS_SHIFT_REG_INPUT_GPIO_NUMBER, BCM2835_GPIO_FSEL_OUTP);
+    bcm2835_gpio_fsel(PS_SHIFT_REG_CLOCK_GPIO_NUMBER, BCM2835_GPIO_FSEL_OUTP);
+    bcm2835_gpio_fsel(PS_SHIFT_REG_LATCH_GPIO_NUMBER, BCM2835_GPIO_FSEL_OUTP);
+
+    bcm2835_gpio_clr_multi(PS_SHIFT_REG_RESET_MASK | PS_SHIFT_REG_INPUT_MASK | PS_SHIFT_REG_CLOCK_MASK | PS_SHIFT_REG_LATCH_MASK);
+
+    ps_pins_init();
+#if PS_SHIFT_REG_SPI
+    if (ps_pins_register_mask(0) & PS_SPI0_GPIO_MASK)
+    {
+        printf("Key inputs overlap the SPI0 pins, scanner not started\n\r");
+        return;
+    }
+    // the chain is clocked and latched by SPI0, its reset is held off
+    bcm2835_gpio_set(PS_SHIFT_REG_RESET_GPIO_NUMBER);
+    bcm2835_spi_shiftreg_init(PS_SHIFT_REG_SPI_CLOCK_DIVIDER);
+#endif
+    for (size_t line = 0; line < PS_NUMBER_OF_KEYS_PER_BANK; line++)
+    {
+        uint8_t pin = ps_key_input_gpios[line];
+        bcm2835_gpio_fsel(pin, BCM2835_GPIO_FSEL_INPT);
+        bcm2835_gpio_set_pud(pin, BCM2835_GPIO_PUD_DOWN);
+#if PS_SCAN_EDGE_DETECT
+        // only latched in GPEDSn for the scan to read, the gpio interrupts stay off
+        bcm2835_gpio_ren(pin);
+#endif
+    }
+
+    // run producer task, it starts the scan timer once it is running
+    ps_stats_reset();
+#if PS_CALIBRATE_AT_BOOT
+    ps_calibration_start();
+#endif
+    BaseType_t ret = xTaskCreate(ps_producer_task, "key_producer", 512, NULL, 3, NULL);
+    PS_LOG_FMT("Created key producer task %li", ret);
+
+    ret = xTaskCreate(ps_event_task, "key_events", 512, NULL, 2, &event_task);
+    PS_LOG_FMT("Created key event task %li", ret);
+
+    ret = xTaskCreate(ps_command_task, "command", 512, NULL, 1, NULL);
+    PS_LOG_FMT("Created command task %li", ret);
+}
+
+// Runs in interrupt context every PS_SCAN_HALF_BANK_PERIOD_US
+static void ps_scan_timer_handler(uint32_t timer)
+{
+    if (ps_scan_tick())
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(producer_task, &woken);
+        if (woken)
+        {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+// Hooks up the uart interrupts, and the DMA interrupt with PS_DUMP_DMA. Done
+// from the first task to run rather than ps_init(): an interrupt taken before
+// the scheduler starts would have its handler wake, and switch to, a task that
+// is not running yet.
+static void ps_start_uart(void)
+{
+#if PS_MIDI_UART_PL011
+    bcm2835_pl011_set_tx_handler(ps_output_next_byte);
+#else
+    bcm2835_miniuart_set_tx_handler(ps_output_next_byte);
+#endif
+    ps_uart_rx_init();
+#if PS_DUMP_DMA
+    ps_dump_init();
+#endif
+}
+
+// Waits for each frame from the scan timer interrupt and runs the key state
+// machine over it. As the highest priority task it runs first, so it starts the
+// uart before the command task reads from it.
+void ps_producer_task(void *params)
+{
+    uint32_t loops = 0;
+    bool led_on = false;
+    producer_task = xTaskGetCurrentTaskHandle();
+    ps_start_uart();
+#if PS_BENCH_AT_BOOT
+    // before the scan timer starts, and nothing else runs below this task
+    ps_bench_uart();
+    ps_bench_register_access();
+    ps_bench_shift_register();
+#endif
+    ps_scan_reset();
+    bcm2835_set_handler(PS_SCAN_TIMER, ps_scan_timer_handler);
+    bcm2835_systimer_setinterval(PS_SCAN_TIMER, PS_SCAN_HALF_BANK_PERIOD_US);
+    for (;;)
+    {
+        const ps_scan_frame_t *frame;
+        while ((frame = ps_scan_ready_frame()) == NULL)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+
+        loops++;
+        if(loops % 1000 == 0)
+        {
+            if (led_on)
+            {
+                RUN_LED_OFF();
+                led_on = false;
+            }
+            else
+            {
+                RUN_LED_ON();
+                led_on = true;
+            }
+        }
+
+        uint32_t process_start_time = READ_U32BIT_US_TIME();
+        ps_process_frame(frame);
+        ps_stats_frame(frame->time[0], process_start_time, READ_U32BIT_US_TIME());
+        ps_scan_release_frame();
+        if (ps_events_pending())
+        {
+            xTaskNotifyGive(event_task);
+        }
+    }
+}
+
+// Turns the key events queued by the producer task into midi, statistics and
+// log output. It runs below the producer task, so a burst of notes delays the
+// midi rather than the next scan frame.
+void ps_event_task(void *params)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ps_events_dispatch();
+    }
+}
+
+// stdio once the tasks are running: queued on the diagnostic output class and
+// sent by the uart interrupt between midi messages, or with PS_DUMP_DMA sent by
+// DMA while no midi is waiting, rather than spinning on the uart. Text dropped
+// by PS_OUTPUT_WRITE_POLICY counts as written.
+static int ps_stdio_write(int fd, const void *buf, size_t count)
+{
+#if PS_DUMP_DMA
+    ps_dump_write(buf, count);
+#else
+    ps_output_write(buf, count);
+#endif
+    return count;
+}
+
+// Sleeps until at least one byte has been received
+static int ps_stdio_read(int fd, void *buf, size_t count)
+{
+    return ps_uart_rx_read(buf, count, PS_UART_RX_WAIT_FOREVER);
+}
+
+// Single character commands received on the uart, and formatting the log
+// lines recorded since the last poll. This task owns stdio, the uart receive
+// ring and the diagnostic output class from here on.
+//   d - dump the scan and output statistics
+//   r - reset the scan and output statistics
+//   v - switch to the next velocity profile
+//   h - switch high resolution (14 bit) velocity on or off
+//   c - start a calibration session, or end one and apply and print the result
+//   k - print the current per-key calibration
+void ps_command_task(void *params)
+{
+    libc_set_write_handler(ps_stdio_write);
+    libc_set_read_handler(ps_stdio_read);
+    for (;;)
+    {
+        // woken by a command, or after PS_COMMAND_POLL_MS to flush the log
+        char command;
+        size_t received = ps_uart_rx_read(&command, 1, PS_COMMAND_POLL_MS);
+        ps_log_flush();
+        if (received)
+        {
+            switch (command)
+            {
+            case 'd':
+                ps_stats_dump();
+                ps_output_dump();
+                ps_uart_rx_dump();
+#if PS_DUMP_DMA
+                ps_dump_print_stats();
+#endif
+                break;
+            case 'r':
+                ps_stats_reset();
+                ps_events_reset_stats();
+                ps_output_reset_stats();
+                ps_log_reset_stats();
+                ps_uart_rx_reset_stats();
+#if PS_DUMP_DMA
+                ps_dump_reset_stats();
+#endif
+                printf("Statistics reset\n\r");
+                break;
+            case 'v':
+                ps_velocity_select((ps_velocity_selected_profile() + 1) % ps_velocity_profile_count());
+                printf("Velocity profile : %s\n\r", ps_velocity_profile(ps_velocity_selected_profile())->name);
+                break;
+            case 'h':
+                ps_set_high_res_velocity(!ps_high_res_velocity());
+                printf("High resolution velocity : %s\n\r", ps_high_res_velocity() ? "on" : "off");
+                break;
+            case 'c':
+                if (ps_calibration_active())
+                {
+                    printf("Calibrated %i keys\n\r", ps_calibration_stop());
+                    ps_calibration_dump();
+                }
+                else
+                {
+                    ps_calibration_start();
+                    printf("Calibrating, play every key from softest to hardest then send c\n\r");
+                }
+                break;
+            case 'k':
+                ps_calibration_dump();
+                break;
+            }
+        }
+    }
+}
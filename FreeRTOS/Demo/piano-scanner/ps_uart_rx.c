@@ -0,0 +1,96 @@
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "ps_uart_rx.h"
+#include "ps_ring.h"
+#include "piano_scanner.h"
+#include "bcm2835_miniuart.h"
+#include "bcm2835_pl011.h"
+
+#if !PS_RING_IS_POWER_OF_TWO(PS_UART_RX_QUEUE_BYTES)
+#error "PS_UART_RX_QUEUE_BYTES must be a power of two"
+#endif
+
+static uint8_t storage[PS_UART_RX_QUEUE_BYTES];
+static ps_ring_t queue;
+static SemaphoreHandle_t received_semaphore;
+
+static volatile uint32_t received;
+static volatile uint32_t dropped;
+// the driver's overrun count when the stats were last reset
+static uint32_t overruns_base;
+
+#if PS_MIDI_UART_PL011
+#define ps_uart_rx_overruns() bcm2835_pl011_rx_overruns()
+#else
+#define ps_uart_rx_overruns() bcm2835_miniuart_rx_overruns()
+#endif
+
+// Runs in interrupt context, once for each byte taken from the receiver FIFO.
+// The semaphore is binary, so a burst of bytes wakes the reader once.
+static void ps_uart_rx_byte(char c)
+{
+    received++;
+    if (!ps_ring_push(&queue, &c, 1))
+    {
+        dropped++;
+        return;
+    }
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(received_semaphore, &woken);
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void ps_uart_rx_init(void)
+{
+    ps_ring_init(&queue, storage, sizeof(storage));
+    received_semaphore = xSemaphoreCreateBinary();
+    ps_uart_rx_reset_stats();
+#if PS_MIDI_UART_PL011
+    bcm2835_pl011_set_rx_handler(ps_uart_rx_byte);
+#else
+    bcm2835_miniuart_set_rx_handler(ps_uart_rx_byte);
+#endif
+}
+
+size_t ps_uart_rx_read(void *buf, size_t count, uint32_t timeout_ms)
+{
+    uint8_t *bytes = buf;
+    TickType_t wait = timeout_ms == PS_UART_RX_WAIT_FOREVER ? portMAX_DELAY : timeout_ms / portTICK_PERIOD_MS;
+    TimeOut_t timeout;
+    vTaskSetTimeOutState(&timeout);
+    for (;;)
+    {
+        size_t copied = 0;
+        while (copied < count && ps_ring_pop_byte(&queue, &bytes[copied]))
+        {
+            copied++;
+        }
+        // the semaphore can still be given for bytes already copied, so an
+        // empty ring after taking it means wait again for what is left
+        if (copied > 0 || count == 0 || xTaskCheckForTimeOut(&timeout, &wait)
+            || xSemaphoreTake(received_semaphore, wait) == pdFALSE)
+        {
+            return copied;
+        }
+    }
+}
+
+void ps_uart_rx_dump(void)
+{
+    printf("Uart rx: received:%" PRIu32 " dropped:%" PRIu32 " overruns:%" PRIu32 "\n\r",
+           received, dropped, ps_uart_rx_overruns() - overruns_base);
+}
+
+void ps_uart_rx_reset_stats(void)
+{
+    received = 0;
+    dropped = 0;
+    overruns_base = ps_uart_rx_overruns();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Interrupt driven uart receive, for commands now and midi in later. The uart
+// interrupt (mini uart or PL011, see PS_MIDI_UART_PL011) empties the receive
+// FIFO into a ring (see ps_ring.h)
+// and gives a semaphore, so a task waiting for input sleeps instead of
+// spinning on the line status.
+//
+// The ring is single producer / single consumer: the producer is the
+// interrupt, and only one task at a time may read. On the Pi that is the
+// command task, through ps_uart_rx_read() and stdio.
+
+// Ring size in bytes, must be a power of two. 22ms of input at 115200 baud.
+#ifndef PS_UART_RX_QUEUE_BYTES
+#define PS_UART_RX_QUEUE_BYTES 256
+#endif
+
+// Timeout for ps_uart_rx_read() that never expires
+#define PS_UART_RX_WAIT_FOREVER UINT32_MAX
+
+// Creates the semaphore and starts the receive interrupt. Call from a task,
+// before anything reads.
+void ps_uart_rx_init(void);
+
+// Copies up to count received bytes into buf. Waits up to timeout_ms for the
+// first one if none are queued, returns how many were copied, 0 if the wait
+// timed out.
+size_t ps_uart_rx_read(void *buf, size_t count, uint32_t timeout_ms);
+
+// Prints the bytes received, the bytes lost to a full ring and the bytes lost
+// to the receiver FIFO overflowing before the interrupt emptied it
+void ps_uart_rx_dump(void);
+
+void ps_uart_rx_reset_stats(void);
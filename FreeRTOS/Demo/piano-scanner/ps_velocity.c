@@ -0,0 +1,290 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "piano_scanner.h"
+#include "ps_velocity.h"
+
+// The curves are only evaluated when a table is built. There is no libm in the
+// Pi build so the exponential is done here; the shape constant sets how far the
+// log and exp curves bend away from linear.
+#define PS_VELOCITY_CURVE_SHAPE 4.0f
+
+static const ps_velocity_profile_t profiles[] =
+{
+    { "EP-50 linear", PS_VELOCITY_CURVE_LINEAR, PS_MIN_KEY_TIME_US, PS_MAX_KEY_TIME_US, MIDI_MIN_VELOCITY, MIDI_MAX_VELOCITY, { 0 } },
+    { "EP-50 soft", PS_VELOCITY_CURVE_LOG, PS_MIN_KEY_TIME_US, PS_MAX_KEY_TIME_US, MIDI_MIN_VELOCITY, MIDI_MAX_VELOCITY, { 0 } },
+    { "EP-50 hard", PS_VELOCITY_CURVE_EXP, PS_MIN_KEY_TIME_US, PS_MAX_KEY_TIME_US, MIDI_MIN_VELOCITY, MIDI_MAX_VELOCITY, { 0 } },
+    { "EP-50 s-curve", PS_VELOCITY_CURVE_CUSTOM, PS_MIN_KEY_TIME_US, PS_MAX_KEY_TIME_US, MIDI_MIN_VELOCITY, MIDI_MAX_VELOCITY,
+      { 127, 118, 104, 86, 64, 44, 26, 12, 1 } },
+};
+
+#define PS_VELOCITY_PROFILES ((int)(sizeof(profiles) / sizeof(profiles[0])))
+
+// Release velocities have a single fixed curve
+static const ps_velocity_profile_t release_profile =
+{
+    "EP-50 release", PS_VELOCITY_CURVE_LINEAR, PS_MIN_RELEASE_TIME_US, PS_MAX_RELEASE_TIME_US, MIDI_MIN_VELOCITY, MIDI_MAX_VELOCITY, { 0 }
+};
+
+_Static_assert(PS_MAX_RELEASE_TIME_US > PS_MIN_RELEASE_TIME_US && PS_MAX_RELEASE_TIME_US - PS_MIN_RELEASE_TIME_US <= PS_VELOCITY_MAX_RANGE_US,
+               "the release time range does not fit the velocity table");
+
+_Static_assert(PS_VELOCITY_PROFILE < PS_VELOCITY_PROFILES, "PS_VELOCITY_PROFILE is not one of the profiles in ps_velocity.c");
+
+typedef struct
+{
+    const ps_velocity_profile_t *profile;
+    uint16_t table[PS_VELOCITY_TABLE_SIZE + 1];
+} ps_velocity_table_t;
+
+// Double buffered so a new profile can be built while the scanner reads the
+// old one. The profile travels with its table so a reader never sees a mix.
+static ps_velocity_table_t tables[2];
+static ps_velocity_table_t *volatile active;
+static uint16_t release_table[PS_VELOCITY_TABLE_SIZE + 1];
+static int8_t key_offset[PS_NUMBER_OF_KEYS];
+static ps_velocity_calibration_t key_calibration[PS_NUMBER_OF_KEYS];
+
+#if PS_VELOCITY_CALIBRATION_TABLE
+static const ps_velocity_calibration_t calibration_table[PS_NUMBER_OF_KEYS] =
+{
+#include "ps_calibration_table.h"
+};
+#endif
+
+// e^y for 0 <= y <= PS_VELOCITY_CURVE_SHAPE: a short series on y/16, squared four times
+static float ps_velocity_exp(float y)
+{
+    float a = y / 16;
+    float e = 1 + a * (1 + a / 2 * (1 + a / 3 * (1 + a / 4)));
+    for (int i = 0; i < 4; i++)
+    {
+        e *= e;
+    }
+    return e;
+}
+
+// 0 at x = 0 rising to 1 at x = 1
+static float ps_velocity_exp_shape(float x)
+{
+    return (ps_velocity_exp(PS_VELOCITY_CURVE_SHAPE * x) - 1) / (ps_velocity_exp(PS_VELOCITY_CURVE_SHAPE) - 1);
+}
+
+// Exact velocity of a profile, before any key offset
+static float ps_velocity_curve(const ps_velocity_profile_t *p, uint32_t time_us)
+{
+    if (time_us <= p->min_time_us)
+    {
+        return p->max_velocity;
+    }
+    float x = (float)(time_us - p->min_time_us) / (float)(p->max_time_us - p->min_time_us);
+    PS_SATURATE(1.0f, 0.0f, x);
+
+    // fraction of the way from max to min velocity
+    float fall;
+    switch (p->curve)
+    {
+    case PS_VELOCITY_CURVE_LOG:
+        fall = 1 - ps_velocity_exp_shape(1 - x);
+        break;
+    case PS_VELOCITY_CURVE_EXP:
+        fall = ps_velocity_exp_shape(x);
+        break;
+    case PS_VELOCITY_CURVE_CUSTOM:
+    {
+        float position = x * (PS_VELOCITY_CUSTOM_POINTS - 1);
+        int point = (int)position;
+        if (point >= PS_VELOCITY_CUSTOM_POINTS - 1)
+        {
+            return p->points[PS_VELOCITY_CUSTOM_POINTS - 1];
+        }
+        float fraction = position - point;
+        return p->points[point] + (p->points[point + 1] - p->points[point]) * fraction;
+    }
+    case PS_VELOCITY_CURVE_LINEAR:
+    default:
+        fall = x;
+        break;
+    }
+    return p->max_velocity - (p->max_velocity - p->min_velocity) * fall;
+}
+
+// Stretches a key's own range of times onto the profile's.
+// The ARM1176 has no cheap 64 bit multiply so the product is split at
+// PS_VELOCITY_SCALE_SHIFT into two 32 bit multiplies, which is exact for times
+// below PS_VELOCITY_CALIBRATE_MAX_US. Longer times are far off the end of any
+// profile's curve and are clamped.
+#define PS_VELOCITY_CALIBRATE_MAX_US ((1u << 24) - 1)
+static uint32_t ps_velocity_calibrate(int key, uint32_t time_us)
+{
+    const ps_velocity_calibration_t *c = &key_calibration[key];
+    if (time_us > PS_VELOCITY_CALIBRATE_MAX_US) time_us = PS_VELOCITY_CALIBRATE_MAX_US;
+    uint32_t scaled = (time_us >> PS_VELOCITY_SCALE_SHIFT) * c->scale
+                    + (((time_us & (PS_VELOCITY_SCALE_ONE - 1)) * c->scale) >> PS_VELOCITY_SCALE_SHIFT);
+    int32_t calibrated = (int32_t)scaled + c->offset;
+    return calibrated > 0 ? (uint32_t)calibrated : 0;
+}
+
+// Fine velocity of a profile's curve, rounded
+static uint16_t ps_velocity_curve_fine(const ps_velocity_profile_t *p, uint32_t time_us)
+{
+    uint32_t fine = (uint32_t)(ps_velocity_curve(p, time_us) * PS_VELOCITY_FINE_ONE + 0.5f);
+    PS_SATURATE(PS_VELOCITY_FINE_MAX, 0, fine);
+    return (uint16_t)fine;
+}
+
+static void ps_velocity_build_table(const ps_velocity_profile_t *p, uint16_t *table)
+{
+    for (uint32_t i = 0; i <= PS_VELOCITY_TABLE_SIZE; i++)
+    {
+        table[i] = ps_velocity_curve_fine(p, p->min_time_us + (i << PS_VELOCITY_TIME_SHIFT));
+    }
+}
+
+// Interpolates between the two entries either side of the time
+static uint16_t ps_velocity_lookup(const ps_velocity_profile_t *p, const uint16_t *table, uint32_t time_us)
+{
+    if (time_us <= p->min_time_us)
+    {
+        return table[0];
+    }
+    uint32_t step = time_us - p->min_time_us;
+    uint32_t index = step >> PS_VELOCITY_TIME_SHIFT;
+    if (index >= PS_VELOCITY_TABLE_SIZE)
+    {
+        return table[PS_VELOCITY_TABLE_SIZE];
+    }
+    int32_t fraction = step & ((1 << PS_VELOCITY_TIME_SHIFT) - 1);
+    return table[index] + (((table[index + 1] - table[index]) * fraction) >> PS_VELOCITY_TIME_SHIFT);
+}
+
+static uint8_t ps_velocity_apply_offset(int key, int velocity)
+{
+    velocity += key_offset[key];
+    PS_SATURATE(MIDI_MAX_VELOCITY, MIDI_MIN_VELOCITY, velocity);
+    return (uint8_t)velocity;
+}
+
+static uint16_t ps_velocity_apply_offset_fine(int key, int fine)
+{
+    fine += key_offset[key] * PS_VELOCITY_FINE_ONE;
+    PS_SATURATE(PS_VELOCITY_FINE_MAX, MIDI_MIN_VELOCITY * PS_VELOCITY_FINE_ONE, fine);
+    return (uint16_t)fine;
+}
+
+// Rounds a fine velocity to 7 bits
+static uint8_t ps_velocity_coarse(uint32_t fine)
+{
+    uint32_t velocity = (fine + PS_VELOCITY_FINE_ONE / 2) >> PS_VELOCITY_FINE_SHIFT;
+    PS_SATURATE(MIDI_MAX_VELOCITY, 0, velocity);
+    return (uint8_t)velocity;
+}
+
+int ps_velocity_profile_count(void)
+{
+    return PS_VELOCITY_PROFILES;
+}
+
+const ps_velocity_profile_t *ps_velocity_profile(int index)
+{
+    return index >= 0 && index < PS_VELOCITY_PROFILES ? &profiles[index] : NULL;
+}
+
+int ps_velocity_selected_profile(void)
+{
+    return active->profile - profiles;
+}
+
+bool ps_velocity_select(int index)
+{
+    const ps_velocity_profile_t *p = ps_velocity_profile(index);
+    if (!p || p->max_time_us <= p->min_time_us || p->max_time_us - p->min_time_us > PS_VELOCITY_MAX_RANGE_US)
+    {
+        return false;
+    }
+
+    ps_velocity_table_t *next = active == &tables[0] ? &tables[1] : &tables[0];
+    ps_velocity_build_table(p, next->table);
+    next->profile = p;
+    active = next;
+    return true;
+}
+
+void ps_velocity_init(void)
+{
+    memset(key_offset, 0, sizeof(key_offset));
+    for (int key = 0; key < PS_NUMBER_OF_KEYS; key++)
+    {
+#if PS_VELOCITY_CALIBRATION_TABLE
+        key_calibration[key] = calibration_table[key];
+#else
+        key_calibration[key].scale = PS_VELOCITY_SCALE_ONE;
+        key_calibration[key].offset = 0;
+#endif
+    }
+    ps_velocity_select(PS_VELOCITY_PROFILE);
+    ps_velocity_build_table(&release_profile, release_table);
+}
+
+void ps_velocity_set_key_offset(int key, int8_t offset)
+{
+    if (key >= 0 && key < PS_NUMBER_OF_KEYS)
+    {
+        key_offset[key] = offset;
+    }
+}
+
+void ps_velocity_set_key_calibration(int key, ps_velocity_calibration_t calibration)
+{
+    if (key >= 0 && key < PS_NUMBER_OF_KEYS)
+    {
+        key_calibration[key] = calibration;
+    }
+}
+
+ps_velocity_calibration_t ps_velocity_key_calibration(int key)
+{
+    return key_calibration[key];
+}
+
+uint16_t ps_velocity_map_fine(int key, uint32_t time_us)
+{
+    const ps_velocity_table_t *t = active;
+    return ps_velocity_apply_offset_fine(key, ps_velocity_lookup(t->profile, t->table, ps_velocity_calibrate(key, time_us)));
+}
+
+uint8_t ps_velocity_map(int key, uint32_t time_us)
+{
+    return ps_velocity_coarse(ps_velocity_map_fine(key, time_us));
+}
+
+uint8_t ps_velocity_exact(int key, uint32_t time_us)
+{
+    return ps_velocity_apply_offset(key, (int)(ps_velocity_curve(active->profile, ps_velocity_calibrate(key, time_us)) + 0.5f));
+}
+
+uint16_t ps_velocity_exact_fine(int key, uint32_t time_us)
+{
+    return ps_velocity_apply_offset_fine(key, ps_velocity_curve_fine(active->profile, ps_velocity_calibrate(key, time_us)));
+}
+
+uint16_t ps_velocity_map_release_fine(uint32_t time_us)
+{
+    return ps_velocity_lookup(&release_profile, release_table, time_us);
+}
+
+uint8_t ps_velocity_map_release(uint32_t time_us)
+{
+    return ps_velocity_coarse(ps_velocity_map_release_fine(time_us));
+}
+
+uint8_t ps_velocity_release_exact(uint32_t time_us)
+{
+    return (uint8_t)(ps_velocity_curve(&release_profile, time_us) + 0.5f);
+}
+
+uint16_t ps_velocity_release_exact_fine(uint32_t time_us)
+{
+    return ps_velocity_curve_fine(&release_profile, time_us);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "piano_scanner.h"
+
+// Velocity engine. Make to break times are mapped to midi velocities through a
+// table built from the selected keyboard profile when it is selected, so a hit
+// costs one table lookup and a per-key offset instead of soft-float arithmetic.
+//
+// The tables hold fine velocities, 7 bit velocities with another 7 bits of
+// fraction (PS_VELOCITY_FINE_SHIFT), and the lookup interpolates between the
+// two entries either side of the time. The fine velocity keeps the resolution
+// of the measured time for the high resolution midi output; the plain 7 bit
+// velocity is it rounded.
+//
+// Each key can also carry a calibration that stretches its own range of times
+// onto the profile's before the lookup (see ps_calibration.c):
+//     time' = (time * scale >> PS_VELOCITY_SCALE_SHIFT) + offset
+//
+// Table entry n is the velocity at profile min time + (n << PS_VELOCITY_TIME_SHIFT).
+// Times below the profile's min time give its max velocity, times past the
+// end of its range its min velocity.
+
+#define PS_VELOCITY_TIME_SHIFT 7
+#define PS_VELOCITY_TABLE_SIZE 1024
+// Longest range (max time - min time) a profile can cover
+#define PS_VELOCITY_MAX_RANGE_US (PS_VELOCITY_TABLE_SIZE << PS_VELOCITY_TIME_SHIFT)
+
+// Control points of a custom curve, evenly spaced from min to max time
+#define PS_VELOCITY_CUSTOM_POINTS 9
+
+#define PS_VELOCITY_FINE_SHIFT 7
+#define PS_VELOCITY_FINE_ONE (1 << PS_VELOCITY_FINE_SHIFT)
+#define PS_VELOCITY_FINE_MAX ((MIDI_MAX_VELOCITY << PS_VELOCITY_FINE_SHIFT) | (PS_VELOCITY_FINE_ONE - 1))
+
+#define PS_VELOCITY_SCALE_SHIFT 12
+#define PS_VELOCITY_SCALE_ONE (1 << PS_VELOCITY_SCALE_SHIFT)
+
+typedef struct
+{
+    uint16_t scale;
+    int32_t offset;
+} ps_velocity_calibration_t;
+
+// Build with PS_VELOCITY_CALIBRATION_TABLE set to start with the per-key
+// calibration in ps_calibration_table.h, as printed by ps_calibration_dump()
+#ifndef PS_VELOCITY_CALIBRATION_TABLE
+#define PS_VELOCITY_CALIBRATION_TABLE 0
+#endif
+
+typedef enum
+{
+    PS_VELOCITY_CURVE_LINEAR,
+    PS_VELOCITY_CURVE_LOG,  // velocity falls away quickly as strokes slow: soft unless struck hard
+    PS_VELOCITY_CURVE_EXP,  // velocity holds up as strokes slow: loud without much force
+    PS_VELOCITY_CURVE_CUSTOM
+} ps_velocity_curve_t;
+
+typedef struct
+{
+    const char *name;
+    ps_velocity_curve_t curve;
+    uint32_t min_time_us;
+    uint32_t max_time_us;
+    uint8_t min_velocity;
+    uint8_t max_velocity;
+    // velocities at the control points, fastest first, PS_VELOCITY_CURVE_CUSTOM only
+    uint8_t points[PS_VELOCITY_CUSTOM_POINTS];
+} ps_velocity_profile_t;
+
+// Profile selected at start up, an index into the profiles in ps_velocity.c
+#ifndef PS_VELOCITY_PROFILE
+#define PS_VELOCITY_PROFILE 0
+#endif
+
+// Builds the table for PS_VELOCITY_PROFILE and resets the key offsets and
+// calibration
+void ps_velocity_init(void);
+
+int ps_velocity_profile_count(void);
+const ps_velocity_profile_t *ps_velocity_profile(int index);
+int ps_velocity_selected_profile(void);
+
+// Builds the table for a profile and switches to it. Safe while the scanner
+// runs: the new table is built aside and swapped in with a single store.
+bool ps_velocity_select(int index);
+
+void ps_velocity_set_key_offset(int key, int8_t offset);
+
+void ps_velocity_set_key_calibration(int key, ps_velocity_calibration_t calibration);
+ps_velocity_calibration_t ps_velocity_key_calibration(int key);
+
+// Hot path: velocity for a make to break time on a key
+uint8_t ps_velocity_map(int key, uint32_t time_us);
+uint16_t ps_velocity_map_fine(int key, uint32_t time_us);
+
+// The selected curve evaluated exactly, without the table. For checking the
+// table and the scanner against, not for the hot path.
+uint8_t ps_velocity_exact(int key, uint32_t time_us);
+uint16_t ps_velocity_exact_fine(int key, uint32_t time_us);
+
+// Release velocity for a break to make time as the key comes up. Releases use
+// one fixed linear curve over PS_MIN_RELEASE_TIME_US to PS_MAX_RELEASE_TIME_US
+// whatever profile is selected, with no per-key offset or calibration.
+uint8_t ps_velocity_map_release(uint32_t time_us);
+uint16_t ps_velocity_map_release_fine(uint32_t time_us);
+uint8_t ps_velocity_release_exact(uint32_t time_us);
+uint16_t ps_velocity_release_exact_fine(uint32_t time_us);